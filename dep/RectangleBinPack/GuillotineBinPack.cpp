@@ -629,8 +629,8 @@ extern "C"
 			width
 			, height
 			, merge
-			, GuillotineBinPack::RectBestAreaFit//rectChoice
-			, GuillotineBinPack::SplitShorterLeftoverAxis//splitMethod
+			, static_cast<GuillotineBinPack::FreeRectChoiceHeuristic>(rectChoice)
+			, static_cast<GuillotineBinPack::GuillotineSplitHeuristic>(splitMethod)
 		);
 		RectC ret = {r.x, r.y, r.width, r.height};
 		
@@ -17,24 +17,201 @@
 #include "MaxRectsBinPack.h"
 #include <stdint.h> /* uint64_t */
 
+// SIMD scoring is compiled for x86 with GCC or Clang, and used if the processor supports it.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(MAXRECTS_NO_SIMD)
+#define MAXRECTS_SIMD
+#include <immintrin.h>
+#endif
+
 namespace rbp {
 
 using namespace std;
 
+#ifdef MAXRECTS_SIMD
+
+/// @return 2 if AVX2 is supported, 1 if SSE4.1 is, 0 otherwise.
+static int SIMDLevel()
+{
+	static const int level = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse4.1") ? 1 : 0;
+
+	return level;
+}
+
+// Both kernels below keep the best (score1, score2) found in each lane, along with its order
+// (free rectangle index times two, plus one if flipped). Candidates reach each lane in
+// increasing order and only strictly better ones are kept, so taking the lowest order among
+// the lanes tied for best afterwards picks the same candidate as the scalar loops do.
+
+/// Scores one orientation of the new node against 8 free rectangles.
+__attribute__((target("avx2")))
+static inline void ScoreAVX2(int method, __m256i x, __m256i y, __m256i fw, __m256i fh,
+	int width, int height, int area, __m256i order, __m256i &best1, __m256i &best2, __m256i &bestOrder)
+{
+	const __m256i w = _mm256_set1_epi32(width);
+	const __m256i h = _mm256_set1_epi32(height);
+	const __m256i fits = _mm256_and_si256(
+		_mm256_cmpgt_epi32(fw, _mm256_sub_epi32(w, _mm256_set1_epi32(1))),
+		_mm256_cmpgt_epi32(fh, _mm256_sub_epi32(h, _mm256_set1_epi32(1))));
+	const __m256i leftoverHoriz = _mm256_sub_epi32(fw, w);
+	const __m256i leftoverVert = _mm256_sub_epi32(fh, h);
+	const __m256i worst = _mm256_set1_epi32(std::numeric_limits<int>::max());
+	__m256i s1;
+	__m256i s2;
+
+	switch(method)
+	{
+	case MaxRectsBinPack::RectBestShortSideFit:
+		s1 = _mm256_min_epi32(leftoverHoriz, leftoverVert);
+		s2 = _mm256_max_epi32(leftoverHoriz, leftoverVert);
+		break;
+	case MaxRectsBinPack::RectBestLongSideFit:
+		s1 = _mm256_max_epi32(leftoverHoriz, leftoverVert);
+		s2 = _mm256_min_epi32(leftoverHoriz, leftoverVert);
+		break;
+	case MaxRectsBinPack::RectBestAreaFit:
+		s1 = _mm256_sub_epi32(_mm256_mullo_epi32(fw, fh), _mm256_set1_epi32(area));
+		s2 = _mm256_min_epi32(leftoverHoriz, leftoverVert);
+		break;
+	default: // RectBottomLeftRule
+		s1 = _mm256_add_epi32(y, h);
+		s2 = x;
+		break;
+	}
+
+	s1 = _mm256_blendv_epi8(worst, s1, fits);
+	s2 = _mm256_blendv_epi8(worst, s2, fits);
+
+	const __m256i better = _mm256_or_si256(
+		_mm256_cmpgt_epi32(best1, s1),
+		_mm256_and_si256(_mm256_cmpeq_epi32(best1, s1), _mm256_cmpgt_epi32(best2, s2)));
+	best1 = _mm256_blendv_epi8(best1, s1, better);
+	best2 = _mm256_blendv_epi8(best2, s2, better);
+	bestOrder = _mm256_blendv_epi8(bestOrder, order, better);
+}
+
+__attribute__((target("avx2")))
+static void FindBestAVX2(const int *fx, const int *fy, const int *fw, const int *fh, size_t count,
+	int width, int height, bool allowFlip, int method, int *best1, int *best2, int *bestOrder)
+{
+	__m256i b1 = _mm256_set1_epi32(std::numeric_limits<int>::max());
+	__m256i b2 = b1;
+	__m256i bo = _mm256_set1_epi32(-1);
+	__m256i order = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+	const __m256i step = _mm256_set1_epi32(16);
+	const __m256i one = _mm256_set1_epi32(1);
+
+	for(size_t i = 0; i < count; i += 8, order = _mm256_add_epi32(order, step))
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(fx + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(fy + i));
+		__m256i w = _mm256_loadu_si256((const __m256i *)(fw + i));
+		__m256i h = _mm256_loadu_si256((const __m256i *)(fh + i));
+
+		ScoreAVX2(method, x, y, w, h, width, height, width * height, order, b1, b2, bo);
+		if (allowFlip)
+			ScoreAVX2(method, x, y, w, h, height, width, width * height, _mm256_add_epi32(order, one), b1, b2, bo);
+	}
+
+	_mm256_storeu_si256((__m256i *)best1, b1);
+	_mm256_storeu_si256((__m256i *)best2, b2);
+	_mm256_storeu_si256((__m256i *)bestOrder, bo);
+}
+
+/// Scores one orientation of the new node against 4 free rectangles.
+__attribute__((target("sse4.1")))
+static inline void ScoreSSE41(int method, __m128i x, __m128i y, __m128i fw, __m128i fh,
+	int width, int height, int area, __m128i order, __m128i &best1, __m128i &best2, __m128i &bestOrder)
+{
+	const __m128i w = _mm_set1_epi32(width);
+	const __m128i h = _mm_set1_epi32(height);
+	const __m128i fits = _mm_and_si128(
+		_mm_cmpgt_epi32(fw, _mm_sub_epi32(w, _mm_set1_epi32(1))),
+		_mm_cmpgt_epi32(fh, _mm_sub_epi32(h, _mm_set1_epi32(1))));
+	const __m128i leftoverHoriz = _mm_sub_epi32(fw, w);
+	const __m128i leftoverVert = _mm_sub_epi32(fh, h);
+	const __m128i worst = _mm_set1_epi32(std::numeric_limits<int>::max());
+	__m128i s1;
+	__m128i s2;
+
+	switch(method)
+	{
+	case MaxRectsBinPack::RectBestShortSideFit:
+		s1 = _mm_min_epi32(leftoverHoriz, leftoverVert);
+		s2 = _mm_max_epi32(leftoverHoriz, leftoverVert);
+		break;
+	case MaxRectsBinPack::RectBestLongSideFit:
+		s1 = _mm_max_epi32(leftoverHoriz, leftoverVert);
+		s2 = _mm_min_epi32(leftoverHoriz, leftoverVert);
+		break;
+	case MaxRectsBinPack::RectBestAreaFit:
+		s1 = _mm_sub_epi32(_mm_mullo_epi32(fw, fh), _mm_set1_epi32(area));
+		s2 = _mm_min_epi32(leftoverHoriz, leftoverVert);
+		break;
+	default: // RectBottomLeftRule
+		s1 = _mm_add_epi32(y, h);
+		s2 = x;
+		break;
+	}
+
+	s1 = _mm_blendv_epi8(worst, s1, fits);
+	s2 = _mm_blendv_epi8(worst, s2, fits);
+
+	const __m128i better = _mm_or_si128(
+		_mm_cmpgt_epi32(best1, s1),
+		_mm_and_si128(_mm_cmpeq_epi32(best1, s1), _mm_cmpgt_epi32(best2, s2)));
+	best1 = _mm_blendv_epi8(best1, s1, better);
+	best2 = _mm_blendv_epi8(best2, s2, better);
+	bestOrder = _mm_blendv_epi8(bestOrder, order, better);
+}
+
+__attribute__((target("sse4.1")))
+static void FindBestSSE41(const int *fx, const int *fy, const int *fw, const int *fh, size_t count,
+	int width, int height, bool allowFlip, int method, int *best1, int *best2, int *bestOrder)
+{
+	__m128i b1 = _mm_set1_epi32(std::numeric_limits<int>::max());
+	__m128i b2 = b1;
+	__m128i bo = _mm_set1_epi32(-1);
+	__m128i order = _mm_setr_epi32(0, 2, 4, 6);
+	const __m128i step = _mm_set1_epi32(8);
+	const __m128i one = _mm_set1_epi32(1);
+
+	for(size_t i = 0; i < count; i += 4, order = _mm_add_epi32(order, step))
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(fx + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(fy + i));
+		__m128i w = _mm_loadu_si128((const __m128i *)(fw + i));
+		__m128i h = _mm_loadu_si128((const __m128i *)(fh + i));
+
+		ScoreSSE41(method, x, y, w, h, width, height, width * height, order, b1, b2, bo);
+		if (allowFlip)
+			ScoreSSE41(method, x, y, w, h, height, width, width * height, _mm_add_epi32(order, one), b1, b2, bo);
+	}
+
+	_mm_storeu_si128((__m128i *)best1, b1);
+	_mm_storeu_si128((__m128i *)best2, b2);
+	_mm_storeu_si128((__m128i *)bestOrder, bo);
+}
+
+#endif /* MAXRECTS_SIMD */
+
 MaxRectsBinPack::MaxRectsBinPack()
 :binWidth(0),
-binHeight(0)
+binHeight(0),
+binIndexFreeList(false),
+stamp(0)
 {
 }
 
-MaxRectsBinPack::MaxRectsBinPack(int width, int height, bool allowFlip)
+MaxRectsBinPack::MaxRectsBinPack(int width, int height, bool allowFlip, bool indexFreeList)
+:stamp(0)
 {
-	Init(width, height, allowFlip);
+	Init(width, height, allowFlip, indexFreeList);
 }
 
-void MaxRectsBinPack::Init(int width, int height, bool allowFlip)
+void MaxRectsBinPack::Init(int width, int height, bool allowFlip, bool indexFreeList)
 {
 	binAllowFlip = allowFlip;
+	binIndexFreeList = indexFreeList;
 	binWidth = width;
 	binHeight = height;
 
@@ -48,6 +225,23 @@ void MaxRectsBinPack::Init(int width, int height, bool allowFlip)
 
 	freeRectangles.clear();
 	freeRectangles.push_back(n);
+
+	freeX.clear();
+	freeY.clear();
+	freeWidth.clear();
+	freeHeight.clear();
+	ColumnsUpdate(0);
+
+	if (binIndexFreeList)
+	{
+		// Cells of at least 16x16 units, at most 32 to a side.
+		cellWidth = max(16, (width + 31) / 32);
+		cellHeight = max(16, (height + 31) / 32);
+		cellColumns = max(1, (width + cellWidth - 1) / cellWidth);
+		cellRows = max(1, (height + cellHeight - 1) / cellHeight);
+		cells.assign(cellColumns * cellRows, std::vector<int>());
+		IndexRebuild();
+	}
 }
 
 Rect MaxRectsBinPack::Insert(int width, int height, FreeRectChoiceHeuristic method)
@@ -109,17 +303,50 @@ void MaxRectsBinPack::Insert(std::vector<RectSize> &rects, std::vector<Rect> &ds
 	}
 }
 
+void MaxRectsBinPack::Place(const Rect &node)
+{
+	PlaceRect(node);
+}
+
 void MaxRectsBinPack::PlaceRect(const Rect &node)
 {
-	for(size_t i = 0; i < freeRectangles.size();)
+	if (binIndexFreeList)
 	{
-		if (SplitFreeNode(freeRectangles[i], node))
+		// Visit the free rectangles intersecting the node in the same order as the loop below
+		// does: the last free rectangle takes the place of each one split, and is visited next
+		// if it intersects the node too, otherwise the next one intersecting it is.
+		IndexFindIntersecting(node);
+		for(size_t lo = 0, hi = hits.size(); lo < hi;)
 		{
-			freeRectangles[i] = freeRectangles.back();
-			freeRectangles.pop_back();
+			size_t i = hits[lo];
+			size_t last = freeRectangles.size() - 1;
+
+			SplitFreeNode(freeRectangles[i], node);
+			IndexRemove(i);
+
+			if (i != last && hits[hi - 1] == last)
+			{
+				hits[lo] = i;
+				--hi;
+			}
+			else
+				++lo;
+		}
+	}
+	else
+	{
+		for(size_t i = 0; i < freeRectangles.size();)
+		{
+			if (SplitFreeNode(freeRectangles[i], node))
+			{
+				freeRectangles[i] = freeRectangles.back();
+				freeRectangles.pop_back();
+				ColumnsUpdate(i);
+				ColumnsUpdate(freeRectangles.size());
+			}
+			else
+				++i;
 		}
-		else
-			++i;
 	}
 
 	PruneFreeList();
@@ -163,10 +390,77 @@ double MaxRectsBinPack::Occupancy() const
 	return (double)usedSurfaceArea / ((uint64_t)binWidth * binHeight);
 }
 
+bool MaxRectsBinPack::FindPositionForNewNodeSIMD(int width, int height, FreeRectChoiceHeuristic method,
+	Rect &bestNode, int &score1, int &score2) const
+{
+#ifdef MAXRECTS_SIMD
+	int level = SIMDLevel();
+	size_t count = (freeRectangles.size() + 7) & ~(size_t)7;
+	int best1[8];
+	int best2[8];
+	int bestOrder[8];
+	int lanes = (level == 2) ? 8 : 4;
+
+	if (!level)
+		return false;
+
+	if (level == 2)
+		FindBestAVX2(&freeX[0], &freeY[0], &freeWidth[0], &freeHeight[0], count,
+			width, height, binAllowFlip, method, best1, best2, bestOrder);
+	else
+		FindBestSSE41(&freeX[0], &freeY[0], &freeWidth[0], &freeHeight[0], count,
+			width, height, binAllowFlip, method, best1, best2, bestOrder);
+
+	// Lowest order among the lanes tied for best.
+	int best = -1;
+	for(int i = 0; i < lanes; ++i)
+	{
+		if (bestOrder[i] < 0)
+			continue;
+
+		if (best < 0 || best1[i] < best1[best]
+			|| (best1[i] == best1[best] && (best2[i] < best2[best]
+				|| (best2[i] == best2[best] && bestOrder[i] < bestOrder[best]))))
+			best = i;
+	}
+
+	bestNode = Rect();
+	score1 = std::numeric_limits<int>::max();
+	score2 = std::numeric_limits<int>::max();
+
+	if (best >= 0)
+	{
+		size_t i = bestOrder[best] >> 1;
+		bool flipped = bestOrder[best] & 1;
+
+		bestNode.x = freeRectangles[i].x;
+		bestNode.y = freeRectangles[i].y;
+		bestNode.width = flipped ? height : width;
+		bestNode.height = flipped ? width : height;
+		score1 = best1[best];
+		score2 = best2[best];
+	}
+
+	return true;
+#else
+	(void)width;
+	(void)height;
+	(void)method;
+	(void)bestNode;
+	(void)score1;
+	(void)score2;
+
+	return false;
+#endif
+}
+
 Rect MaxRectsBinPack::FindPositionForNewNodeBottomLeft(int width, int height, int &bestY, int &bestX) const
 {
 	Rect bestNode = {};
 
+	if (FindPositionForNewNodeSIMD(width, height, RectBottomLeftRule, bestNode, bestY, bestX))
+		return bestNode;
+
 	bestY = std::numeric_limits<int>::max();
 	bestX = std::numeric_limits<int>::max();
 
@@ -208,6 +502,9 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestShortSideFit(int width, int heig
 {
 	Rect bestNode = {};
 
+	if (FindPositionForNewNodeSIMD(width, height, RectBestShortSideFit, bestNode, bestShortSideFit, bestLongSideFit))
+		return bestNode;
+
 	bestShortSideFit = std::numeric_limits<int>::max();
 	bestLongSideFit = std::numeric_limits<int>::max();
 
@@ -258,6 +555,9 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestLongSideFit(int width, int heigh
 {
 	Rect bestNode = {};
 
+	if (FindPositionForNewNodeSIMD(width, height, RectBestLongSideFit, bestNode, bestLongSideFit, bestShortSideFit))
+		return bestNode;
+
 	bestShortSideFit = std::numeric_limits<int>::max();
 	bestLongSideFit = std::numeric_limits<int>::max();
 
@@ -308,6 +608,9 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestAreaFit(int width, int height,
 {
 	Rect bestNode = {};
 
+	if (FindPositionForNewNodeSIMD(width, height, RectBestAreaFit, bestNode, bestAreaFit, bestShortSideFit))
+		return bestNode;
+
 	bestAreaFit = std::numeric_limits<int>::max();
 	bestShortSideFit = std::numeric_limits<int>::max();
 
@@ -501,30 +804,73 @@ void MaxRectsBinPack::InsertNewFreeRectangle(const Rect &newFreeRect)
 
 void MaxRectsBinPack::PruneFreeList()
 {
-	// Test all newly introduced free rectangles against old free rectangles.
-	for(size_t i = 0; i < freeRectangles.size(); ++i)
-		for(size_t j = 0; j < newFreeRectangles.size();)
-		{
-			if (IsContainedIn(newFreeRectangles[j], freeRectangles[i]))
+	if (binIndexFreeList)
+	{
+		// A new free rectangle is removed by the first old free rectangle containing it, so
+		// find that one for each, then remove them in the same order as the loop below does.
+		firstContainers.resize(newFreeRectangles.size());
+		for(size_t j = 0; j < newFreeRectangles.size(); ++j)
+			firstContainers[j] = IndexFindFirstContainer(newFreeRectangles[j]);
+
+		hits.assign(firstContainers.begin(), firstContainers.end());
+		sort(hits.begin(), hits.end());
+		hits.erase(unique(hits.begin(), hits.end()), hits.end());
+
+		for(size_t k = 0; k < hits.size() && hits[k] < freeRectangles.size(); ++k)
+			for(size_t j = 0; j < newFreeRectangles.size();)
 			{
-				newFreeRectangles[j] = newFreeRectangles.back();
-				newFreeRectangles.pop_back();
+				if (firstContainers[j] == hits[k])
+				{
+					newFreeRectangles[j] = newFreeRectangles.back();
+					newFreeRectangles.pop_back();
+					firstContainers[j] = firstContainers.back();
+					firstContainers.pop_back();
+				}
+				else
+					++j;
 			}
-			else
+	}
+	else
+	{
+		// Test all newly introduced free rectangles against old free rectangles.
+		for(size_t i = 0; i < freeRectangles.size(); ++i)
+			for(size_t j = 0; j < newFreeRectangles.size();)
 			{
-				// The old free rectangles can never be contained in any of the
-				// new free rectangles (the new free rectangles keep shrinking
-				// in size)
-				assert(!IsContainedIn(freeRectangles[i], newFreeRectangles[j]));
-
-				++j;
+				if (IsContainedIn(newFreeRectangles[j], freeRectangles[i]))
+				{
+					newFreeRectangles[j] = newFreeRectangles.back();
+					newFreeRectangles.pop_back();
+				}
+				else
+				{
+					// The old free rectangles can never be contained in any of the
+					// new free rectangles (the new free rectangles keep shrinking
+					// in size)
+					assert(!IsContainedIn(freeRectangles[i], newFreeRectangles[j]));
+
+					++j;
+				}
 			}
-		}
+	}
 
 	// Merge new and old free rectangles to the group of old free rectangles.
+	size_t merged = freeRectangles.size();
 	freeRectangles.insert(freeRectangles.end(), newFreeRectangles.begin(), newFreeRectangles.end());
 	newFreeRectangles.clear();
 
+	for(size_t i = merged; i < freeRectangles.size(); ++i)
+		ColumnsUpdate(i);
+
+	if (binIndexFreeList)
+	{
+		// Start over once most of the ids handed out have been removed.
+		if (idPositions.size() > freeRectangles.size() * 4 + 1024)
+			IndexRebuild();
+		else
+			for(size_t i = freeIds.size(); i < freeRectangles.size(); ++i)
+				IndexAdd(i);
+	}
+
 #ifdef _DEBUG
 	for(size_t i = 0; i < freeRectangles.size(); ++i)
 		for(size_t j = i+1; j < freeRectangles.size(); ++j)
@@ -535,6 +881,151 @@ void MaxRectsBinPack::PruneFreeList()
 #endif
 }
 
+void MaxRectsBinPack::ColumnsUpdate(size_t position)
+{
+	if (position >= freeX.size())
+	{
+		size_t size = (position + 8) & ~(size_t)7;
+
+		freeX.resize(size, -1);
+		freeY.resize(size, -1);
+		freeWidth.resize(size, -1);
+		freeHeight.resize(size, -1);
+	}
+
+	if (position < freeRectangles.size())
+	{
+		freeX[position] = freeRectangles[position].x;
+		freeY[position] = freeRectangles[position].y;
+		freeWidth[position] = freeRectangles[position].width;
+		freeHeight[position] = freeRectangles[position].height;
+	}
+	else
+	{
+		freeX[position] = -1;
+		freeY[position] = -1;
+		freeWidth[position] = -1;
+		freeHeight[position] = -1;
+	}
+}
+
+void MaxRectsBinPack::IndexRebuild()
+{
+	for(size_t i = 0; i < cells.size(); ++i)
+		cells[i].clear();
+
+	freeIds.clear();
+	idPositions.clear();
+	idStamps.clear();
+
+	for(size_t i = 0; i < freeRectangles.size(); ++i)
+		IndexAdd(i);
+}
+
+void MaxRectsBinPack::IndexAdd(size_t position)
+{
+	const Rect &rect = freeRectangles[position];
+	int id = (int)idPositions.size();
+	int x0 = rect.x / cellWidth;
+	int y0 = rect.y / cellHeight;
+	int x1 = min(cellColumns - 1, (rect.x + rect.width - 1) / cellWidth);
+	int y1 = min(cellRows - 1, (rect.y + rect.height - 1) / cellHeight);
+
+	freeIds.push_back(id);
+	idPositions.push_back((int)position);
+	idStamps.push_back(stamp);
+
+	for(int y = y0; y <= y1; ++y)
+		for(int x = x0; x <= x1; ++x)
+			cells[y * cellColumns + x].push_back(id);
+}
+
+void MaxRectsBinPack::IndexRemove(size_t position)
+{
+	idPositions[freeIds[position]] = -1;
+
+	freeRectangles[position] = freeRectangles.back();
+	freeRectangles.pop_back();
+	freeIds[position] = freeIds.back();
+	freeIds.pop_back();
+
+	if (position < freeIds.size())
+		idPositions[freeIds[position]] = (int)position;
+
+	ColumnsUpdate(position);
+	ColumnsUpdate(freeRectangles.size());
+}
+
+void MaxRectsBinPack::IndexFindIntersecting(const Rect &rect)
+{
+	int x0 = max(0, rect.x / cellWidth);
+	int y0 = max(0, rect.y / cellHeight);
+	int x1 = min(cellColumns - 1, (rect.x + rect.width - 1) / cellWidth);
+	int y1 = min(cellRows - 1, (rect.y + rect.height - 1) / cellHeight);
+
+	hits.clear();
+	++stamp;
+
+	for(int y = y0; y <= y1; ++y)
+		for(int x = x0; x <= x1; ++x)
+		{
+			std::vector<int> &cell = cells[y * cellColumns + x];
+
+			for(size_t i = 0; i < cell.size();)
+			{
+				int id = cell[i];
+				int position = idPositions[id];
+
+				if (position < 0)
+				{
+					cell[i] = cell.back();
+					cell.pop_back();
+					continue;
+				}
+				++i;
+
+				if (idStamps[id] == stamp)
+					continue;
+				idStamps[id] = stamp;
+
+				// Same test as SplitFreeNode().
+				const Rect &freeNode = freeRectangles[position];
+				if (rect.x >= freeNode.x + freeNode.width || rect.x + rect.width <= freeNode.x ||
+					rect.y >= freeNode.y + freeNode.height || rect.y + rect.height <= freeNode.y)
+					continue;
+
+				hits.push_back(position);
+			}
+		}
+
+	sort(hits.begin(), hits.end());
+}
+
+size_t MaxRectsBinPack::IndexFindFirstContainer(const Rect &rect)
+{
+	// Any rectangle containing this one contains its top left corner.
+	std::vector<int> &cell = cells[(rect.y / cellHeight) * cellColumns + rect.x / cellWidth];
+	size_t first = freeRectangles.size();
+
+	for(size_t i = 0; i < cell.size();)
+	{
+		int position = idPositions[cell[i]];
+
+		if (position < 0)
+		{
+			cell[i] = cell.back();
+			cell.pop_back();
+			continue;
+		}
+		++i;
+
+		if ((size_t)position < first && IsContainedIn(rect, freeRectangles[position]))
+			first = position;
+	}
+
+	return first;
+}
+
 extern "C"
 {
 	MaxRectsBinPackC *new_MaxRectsBinPack(int width, int height, int allowFlip)
@@ -552,12 +1043,23 @@ extern "C"
 		Rect r = s->Insert(
 			width
 			, height
-			, MaxRectsBinPack::RectBestShortSideFit
+			, static_cast<MaxRectsBinPack::FreeRectChoiceHeuristic>(method)
 		);
 		RectC ret = {r.x, r.y, r.width, r.height};
 		
 		return ret;
 	}
+	void MaxRectsBinPack_Place(MaxRectsBinPackC *s_, int x, int y, int width, int height)
+	{
+		MaxRectsBinPack *s = static_cast<MaxRectsBinPack *>(s_);
+		Rect r;
+		
+		r.x = x;
+		r.y = y;
+		r.width = width;
+		r.height = height;
+		s->Place(r);
+	}
 }
 
 }
@@ -16,6 +16,7 @@ extern "C" {
 typedef void MaxRectsBinPackC;
 MaxRectsBinPackC *new_MaxRectsBinPack(int width, int height, int allowFlip);
 RectC MaxRectsBinPack_Insert(MaxRectsBinPackC *s_, int width, int height, int method);
+void MaxRectsBinPack_Place(MaxRectsBinPackC *s_, int x, int y, int width, int height);
 void delete_MaxRectsBinPack(MaxRectsBinPackC *s);
 
 #ifdef __cplusplus
@@ -37,11 +38,13 @@ public:
 
 	/// Instantiates a bin of the given size.
 	/// @param allowFlip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees to consider a better placement.
-	MaxRectsBinPack(int width, int height, bool allowFlip = true);
+	/// @param indexFreeList Specifies whether to keep a spatial index of the free rectangles, which speeds up
+	///   placing rectangles into bins with many free rectangles. Placements are identical either way.
+	MaxRectsBinPack(int width, int height, bool allowFlip = true, bool indexFreeList = true);
 
 	/// (Re)initializes the packer to an empty bin of width x height units. Call whenever
 	/// you need to restart with a new bin.
-	void Init(int width, int height, bool allowFlip = true);
+	void Init(int width, int height, bool allowFlip = true, bool indexFreeList = true);
 
 	/// Specifies the different heuristic rules that can be used when deciding where to place a new rectangle.
 	enum FreeRectChoiceHeuristic
@@ -62,6 +65,9 @@ public:
 	/// Inserts a single rectangle into the bin, possibly rotated.
 	Rect Insert(int width, int height, FreeRectChoiceHeuristic method);
 
+	/// Marks the given rectangle as used, e.g. to seed the bin with rectangles placed earlier.
+	void Place(const Rect &node);
+
 	/// Computes the ratio of used surface area to the total bin area.
 	double Occupancy() const;
 
@@ -77,6 +83,28 @@ private:
 	std::vector<Rect> usedRectangles;
 	std::vector<Rect> freeRectangles;
 
+	/// Spatial index of freeRectangles: a uniform grid whose cells list the ids of the free
+	/// rectangles overlapping them. Ids of removed rectangles are dropped from cells lazily.
+	bool binIndexFreeList;
+	int cellWidth;
+	int cellHeight;
+	int cellColumns;
+	int cellRows;
+	std::vector<std::vector<int> > cells;
+	std::vector<int> freeIds; ///< Id of each entry in freeRectangles.
+	std::vector<int> idPositions; ///< Position of each id in freeRectangles, or -1 if removed.
+	std::vector<unsigned> idStamps; ///< Avoids visiting an id twice during one query.
+	unsigned stamp;
+	std::vector<size_t> hits;
+	std::vector<size_t> firstContainers;
+
+	/// freeRectangles as a structure of arrays, for scoring many free rectangles at once. The
+	/// arrays are padded to a multiple of 8 entries with free rectangles nothing can fit into.
+	std::vector<int> freeX;
+	std::vector<int> freeY;
+	std::vector<int> freeWidth;
+	std::vector<int> freeHeight;
+
 	/// Computes the placement score for placing the given rectangle with the given method.
 	/// @param score1 [out] The primary placement score will be outputted here.
 	/// @param score2 [out] The secondary placement score will be outputted here. This isu sed to break ties.
@@ -89,6 +117,12 @@ private:
 	/// Computes the placement score for the -CP variant.
 	int ContactPointScoreNode(int x, int y, int width, int height) const;
 
+	/// Scores every free rectangle for the given method (except -CP) using SIMD instructions, if
+	/// the processor supports them. The result is the same as that of the matching scalar loop.
+	/// @return False if the scalar loop should be used instead.
+	bool FindPositionForNewNodeSIMD(int width, int height, FreeRectChoiceHeuristic method,
+		Rect &bestNode, int &score1, int &score2) const;
+
 	Rect FindPositionForNewNodeBottomLeft(int width, int height, int &bestY, int &bestX) const;
 	Rect FindPositionForNewNodeBestShortSideFit(int width, int height, int &bestShortSideFit, int &bestLongSideFit) const;
 	Rect FindPositionForNewNodeBestLongSideFit(int width, int height, int &bestShortSideFit, int &bestLongSideFit) const;
@@ -102,6 +136,24 @@ private:
 
 	/// Goes through the free rectangle list and removes any redundant entries.
 	void PruneFreeList();
+
+	/// Clears the spatial index and adds every free rectangle to it.
+	void IndexRebuild();
+
+	/// Copies freeRectangles[position] to the structure of arrays, or pads it if past the end.
+	void ColumnsUpdate(size_t position);
+
+	/// Adds freeRectangles[position] to the spatial index.
+	void IndexAdd(size_t position);
+
+	/// Removes freeRectangles[position] from the free list, moving the last one into its place.
+	void IndexRemove(size_t position);
+
+	/// Finds the positions of the free rectangles that intersect the given rectangle, in ascending order.
+	void IndexFindIntersecting(const Rect &rect);
+
+	/// @return The position of the first free rectangle containing the given one, or freeRectangles.size().
+	size_t IndexFindFirstContainer(const Rect &rect);
 };
 
 }
@@ -26,16 +26,18 @@ binHeight(0)
 {
 }
 
-SkylineBinPack::SkylineBinPack(int width, int height, bool useWasteMap)
+SkylineBinPack::SkylineBinPack(int width, int height, bool useWasteMap, bool allowFlip)
 {
-	Init(width, height, useWasteMap);
+	Init(width, height, useWasteMap, allowFlip);
 }
 
-void SkylineBinPack::Init(int width, int height, bool useWasteMap_)
+void SkylineBinPack::Init(int width, int height, bool useWasteMap_, bool allowFlip)
 {
 	binWidth = width;
 	binHeight = height;
 
+	binAllowFlip = allowFlip;
+
 	useWasteMap = useWasteMap_;
 
 #ifdef _DEBUG
@@ -52,7 +54,7 @@ void SkylineBinPack::Init(int width, int height, bool useWasteMap_)
 
 	if (useWasteMap)
 	{
-		wasteMap.Init(width, height);
+		wasteMap.Init(width, height, allowFlip);
 		wasteMap.GetFreeRectangles().clear();
 	}
 }
@@ -317,7 +319,7 @@ Rect SkylineBinPack::FindPositionForNewNodeBottomLeft(int width, int height, int
 				debug_assert(disjointRects.Disjoint(newNode));
 			}
 		}
-		if (RectangleFits(i, height, width, y))
+		if (binAllowFlip && RectangleFits(i, height, width, y))
 		{
 			if (y + width < bestHeight || (y + width == bestHeight && skyLine[i].width < bestWidth))
 			{
@@ -387,7 +389,7 @@ Rect SkylineBinPack::FindPositionForNewNodeMinWaste(int width, int height, int &
 				debug_assert(disjointRects.Disjoint(newNode));
 			}
 		}
-		if (RectangleFits(i, height, width, y, wastedArea))
+		if (binAllowFlip && RectangleFits(i, height, width, y, wastedArea))
 		{
 			if (wastedArea < bestWastedArea || (wastedArea == bestWastedArea && y + width < bestHeight))
 			{
@@ -412,4 +414,29 @@ float SkylineBinPack::Occupancy() const
 	return (float)usedSurfaceArea / (binWidth * binHeight);
 }
 
-}
\ No newline at end of file
+extern "C"
+{
+	SkylineBinPackC *new_SkylineBinPack(int width, int height, int useWasteMap, int allowFlip)
+	{
+		return new SkylineBinPack(width, height, useWasteMap, allowFlip);
+	}
+	void delete_SkylineBinPack(SkylineBinPackC *s)
+	{
+		SkylineBinPack *c = static_cast<SkylineBinPack *>(s);
+		delete c;
+	}
+	RectC SkylineBinPack_Insert(SkylineBinPackC *s_, int width, int height, int method)
+	{
+		SkylineBinPack *s = static_cast<SkylineBinPack *>(s_);
+		Rect r = s->Insert(
+			width
+			, height
+			, static_cast<SkylineBinPack::LevelChoiceHeuristic>(method)
+		);
+		RectC ret = {r.x, r.y, r.width, r.height};
+		
+		return ret;
+	}
+}
+
+}
@@ -7,9 +7,24 @@
 */
 #pragma once
 
+#include "Rect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void SkylineBinPackC;
+SkylineBinPackC *new_SkylineBinPack(int width, int height, int useWasteMap, int allowFlip);
+RectC SkylineBinPack_Insert(SkylineBinPackC *s_, int width, int height, int method);
+void delete_SkylineBinPack(SkylineBinPackC *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
 #include <vector>
 
-#include "Rect.h"
 #include "GuillotineBinPack.h"
 
 namespace rbp {
@@ -23,11 +38,12 @@ public:
 	SkylineBinPack();
 
 	/// Instantiates a bin of the given size.
-	SkylineBinPack(int binWidth, int binHeight, bool useWasteMap);
+	/// @param allowFlip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees to consider a better placement.
+	SkylineBinPack(int binWidth, int binHeight, bool useWasteMap, bool allowFlip = true);
 
 	/// (Re)initializes the packer to an empty bin of width x height units. Call whenever
 	/// you need to restart with a new bin.
-	void Init(int binWidth, int binHeight, bool useWasteMap);
+	void Init(int binWidth, int binHeight, bool useWasteMap, bool allowFlip = true);
 
 	/// Defines the different heuristic rules that can be used to decide how to make the rectangle placements.
 	enum LevelChoiceHeuristic
@@ -52,6 +68,8 @@ private:
 	int binWidth;
 	int binHeight;
 
+	bool binAllowFlip;
+
 #ifdef _DEBUG
 	DisjointRectCollection disjointRects;
 #endif
@@ -95,4 +113,6 @@ private:
 	void MergeSkylines();
 };
 
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * analyze.c <z64.me>
+ * 
+ * EzSpriteSheet's frame analysis pass lives here
+ * 
+ * a freshly decoded frame is swept once, a row at a time: invisible
+ * pixels are set to 0 (and only written back when they weren't 0
+ * already), the cropping rectangle is tracked, and the pixels are
+ * hashed, all while each row is in cache, so a frame's pixels only
+ * have to travel from memory once
+ * 
+ * the hash has to come out the same for identical cropped pixels no
+ * matter where the cropping rectangle sits in its frame, which isn't
+ * known until the sweep is over; so rather than hashing the cropped
+ * pixels in order, each pixel is weighted by A^x * C^y (mod 2^32) and
+ * the weighted pixels are summed; once the sweep is over, the sum is
+ * multiplied by the inverses of A^left and C^top, which is the same
+ * as having weighted each pixel by its position within the cropping
+ * rectangle; sums wrap around the same way regardless of the order
+ * in which they're taken, so every code path below (scalar, SSE2,
+ * AVX2, NEON) produces identical hashes
+ * 
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+	#define ANALYZE_X86
+	#include <immintrin.h>
+#elif defined(__ARM_NEON)
+	#define ANALYZE_NEON
+	#include <arm_neon.h>
+#endif
+
+#define ANALYZE_A 0x9e3779b1u /* weight per column (must be odd) */
+#define ANALYZE_C 0x85ebca77u /* weight per row (must be odd) */
+
+/* what one row turned out to contain */
+struct AnalyzeRow
+{
+	uint32_t sum; /* sum of pixel * A^x */
+	int left;     /* leftmost visible pixel, or -1 if there are none */
+	int right;    /* one past the rightmost visible pixel */
+};
+
+/* multiplicative inverse of an odd number (mod 2^32), via Newton */
+static uint32_t analyze_inverse(uint32_t v)
+{
+	uint32_t inv = v;
+	int i;
+	
+	for (i = 0; i < 5; ++i)
+		inv *= 2 - v * inv;
+	
+	return inv;
+}
+
+/* v raised to the nth power (mod 2^32) */
+static uint32_t analyze_pow(uint32_t v, int n)
+{
+	uint32_t r = 1;
+	
+	for (; n; n >>= 1, v *= v)
+		if (n & 1)
+			r *= v;
+	
+	return r;
+}
+
+/* finish pixels start ... end - 1 of a row one pixel at a time */
+static void analyze_row_tail(uint32_t *row
+	, const uint32_t *weight
+	, int start
+	, int end
+	, struct AnalyzeRow *r
+)
+{
+	int x;
+	
+	for (x = start; x < end; ++x)
+	{
+		uint32_t p = row[x];
+		
+		if (!(p >> 24))
+		{
+			if (p)
+				row[x] = 0;
+			continue;
+		}
+		
+		if (r->left < 0)
+			r->left = x;
+		r->right = x + 1;
+		r->sum += p * weight[x];
+	}
+}
+
+/* narrow the rough extents found a vector at a time down to pixels;
+ * 'first' and 'last' are the first pixels of the leftmost and the
+ * rightmost vectors containing visible pixels, or -1 if none did
+ */
+static void analyze_row_extents(const uint32_t *row
+	, int first
+	, int last
+	, int lanes
+	, struct AnalyzeRow *r
+)
+{
+	int x;
+	
+	if (first < 0)
+		return;
+	
+	/* the tail may have found some too, but never further left */
+	for (x = first; !row[x]; ++x)
+		;
+	r->left = x;
+	
+	if (r->right > last + lanes)
+		return;
+	
+	for (x = last + lanes - 1; !row[x]; --x)
+		;
+	r->right = x + 1;
+}
+
+/* portable fallback */
+static void analyze_row_scalar(uint32_t *row
+	, const uint32_t *weight
+	, int width
+	, struct AnalyzeRow *r
+)
+{
+	analyze_row_tail(row, weight, 0, width, r);
+}
+
+#ifdef ANALYZE_X86
+
+/* multiply 32-bit lanes, keeping the low halves (SSE2 has no pmulld) */
+static inline __m128i analyze_mullo_sse2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	
+	return _mm_unpacklo_epi32(
+		_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0))
+		, _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))
+	);
+}
+
+static void analyze_row_sse2(uint32_t *row
+	, const uint32_t *weight
+	, int width
+	, struct AnalyzeRow *r
+)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	__m128i acc = zero;
+	uint32_t lane[4];
+	int first = -1;
+	int last = -1;
+	int x;
+	
+	for (x = 0; x + 4 <= width; x += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(row + x));
+		__m128i invisible = _mm_cmpeq_epi32(_mm_and_si128(p, alpha), zero);
+		__m128i q = _mm_andnot_si128(invisible, p);
+		
+		/* write back only if something changed */
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(p, q)) != 0xffff)
+			_mm_storeu_si128((__m128i*)(row + x), q);
+		
+		/* nothing visible */
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(q, zero)) == 0xffff)
+			continue;
+		
+		if (first < 0)
+			first = x;
+		last = x;
+		acc = _mm_add_epi32(acc, analyze_mullo_sse2(q
+			, _mm_loadu_si128((const __m128i*)(weight + x))
+		));
+	}
+	
+	_mm_storeu_si128((__m128i*)lane, acc);
+	r->sum = lane[0] + lane[1] + lane[2] + lane[3];
+	
+	analyze_row_tail(row, weight, x, width, r);
+	analyze_row_extents(row, first, last, 4, r);
+}
+
+__attribute__((target("avx2")))
+static void analyze_row_avx2(uint32_t *row
+	, const uint32_t *weight
+	, int width
+	, struct AnalyzeRow *r
+)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	__m256i acc = zero;
+	uint32_t lane[8];
+	int first = -1;
+	int last = -1;
+	int x;
+	int i;
+	
+	for (x = 0; x + 8 <= width; x += 8)
+	{
+		__m256i p = _mm256_loadu_si256((const __m256i*)(row + x));
+		__m256i invisible = _mm256_cmpeq_epi32(_mm256_and_si256(p, alpha), zero);
+		__m256i q = _mm256_andnot_si256(invisible, p);
+		
+		/* write back only if something changed */
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(p, q)) != -1)
+			_mm256_storeu_si256((__m256i*)(row + x), q);
+		
+		/* nothing visible */
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(q, zero)) == -1)
+			continue;
+		
+		if (first < 0)
+			first = x;
+		last = x;
+		acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(q
+			, _mm256_loadu_si256((const __m256i*)(weight + x))
+		));
+	}
+	
+	_mm256_storeu_si256((__m256i*)lane, acc);
+	for (r->sum = 0, i = 0; i < 8; ++i)
+		r->sum += lane[i];
+	
+	analyze_row_tail(row, weight, x, width, r);
+	analyze_row_extents(row, first, last, 8, r);
+}
+
+#endif /* ANALYZE_X86 */
+
+#ifdef ANALYZE_NEON
+
+/* non-zero if any lane is non-zero */
+static inline int analyze_any_neon(uint32x4_t v)
+{
+#ifdef __aarch64__
+	return vmaxvq_u32(v) != 0;
+#else
+	uint32x2_t h = vorr_u32(vget_low_u32(v), vget_high_u32(v));
+	
+	return (vget_lane_u32(h, 0) | vget_lane_u32(h, 1)) != 0;
+#endif
+}
+
+static void analyze_row_neon(uint32_t *row
+	, const uint32_t *weight
+	, int width
+	, struct AnalyzeRow *r
+)
+{
+	const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+	uint32x4_t acc = vdupq_n_u32(0);
+	uint32_t lane[4];
+	int first = -1;
+	int last = -1;
+	int x;
+	
+	for (x = 0; x + 4 <= width; x += 4)
+	{
+		uint32x4_t p = vld1q_u32(row + x);
+		uint32x4_t q = vandq_u32(p, vtstq_u32(p, alpha));
+		
+		/* write back only if something changed */
+		if (analyze_any_neon(veorq_u32(p, q)))
+			vst1q_u32(row + x, q);
+		
+		/* nothing visible */
+		if (!analyze_any_neon(q))
+			continue;
+		
+		if (first < 0)
+			first = x;
+		last = x;
+		acc = vmlaq_u32(acc, q, vld1q_u32(weight + x));
+	}
+	
+	vst1q_u32(lane, acc);
+	r->sum = lane[0] + lane[1] + lane[2] + lane[3];
+	
+	analyze_row_tail(row, weight, x, width, r);
+	analyze_row_extents(row, first, last, 4, r);
+}
+
+#endif /* ANALYZE_NEON */
+
+/* sweep an rgba8888 frame once, zeroing invisible pixels and deriving
+ * its cropping rectangle and a hash of the pixels within it; returns
+ * non-zero if the frame is blank, in which case the rectangle and the
+ * hash are left untouched
+ */
+int analyze_frame(void *rgba
+	, int width
+	, int height
+	, int *cropX
+	, int *cropY
+	, int *cropW
+	, int *cropH
+	, uint64_t *hash
+)
+{
+	void (*each)(uint32_t *row, const uint32_t *weight, int width
+		, struct AnalyzeRow *r
+	) = analyze_row_scalar;
+	uint32_t *pix32 = rgba;
+	uint32_t *weight;
+	uint32_t rowWeight = 1;
+	uint32_t sum = 0;
+	uint64_t h;
+	int top = -1;
+	int bottom = -1;
+	int left = width;
+	int right = -1;
+	int x;
+	int y;
+
+#if defined(ANALYZE_X86)
+	each = __builtin_cpu_supports("avx2") ? analyze_row_avx2 : analyze_row_sse2;
+#elif defined(ANALYZE_NEON)
+	each = analyze_row_neon;
+#endif
+
+	if (width <= 0 || height <= 0)
+		return 1;
+	
+	/* A^x for every column */
+	weight = malloc_safe(width * sizeof(*weight));
+	for (weight[0] = 1, x = 1; x < width; ++x)
+		weight[x] = weight[x - 1] * ANALYZE_A;
+	
+	for (y = 0; y < height; ++y, pix32 += width, rowWeight *= ANALYZE_C)
+	{
+		struct AnalyzeRow r = {0, -1, -1};
+		
+		each(pix32, weight, width, &r);
+		
+		/* nothing visible */
+		if (r.left < 0)
+			continue;
+		
+		if (top < 0)
+			top = y;
+		bottom = y + 1;
+		if (r.left < left)
+			left = r.left;
+		if (r.right > right)
+			right = r.right;
+		sum += r.sum * rowWeight;
+	}
+	
+	free_safe(&weight);
+	
+	if (top < 0)
+		return 1;
+	
+	/* as though each pixel had been weighted by its position
+	 * within the cropping rectangle rather than within the frame
+	 */
+	sum *= analyze_pow(analyze_inverse(ANALYZE_A), left);
+	sum *= analyze_pow(analyze_inverse(ANALYZE_C), top);
+	
+	/* spread the bits (splitmix64 finalizer) */
+	h = sum ^ ((uint64_t)(right - left) << 32) ^ ((uint64_t)(bottom - top) << 48);
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+	h ^= h >> 31;
+	
+	*cropX = left;
+	*cropY = top;
+	*cropW = right - left;
+	*cropH = bottom - top;
+	*hash = h;
+	
+	return 0;
+}
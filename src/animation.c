@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 	#if defined(_WIN32) && (defined(_UNICODE) || defined(UNICODE))
@@ -29,12 +30,16 @@
 #define PIVOT_UNSET -1
 #define CROP_UNSET   -1
 
+#define CACHE_MAGIC   "EZSSCACH"
+#define CACHE_VERSION 4
+
 struct EzSpriteSheetAnimFrame
 {
 	struct EzSpriteSheetAnim *anim; /* animation containing this frame */
 	struct EzSpriteSheetAnimFrame *isDuplicateOf; /* duplicate image data */
 	const void *udata;
-	void *pixels; /* raw pixel data in rgba8888 format */
+	void *pixels; /* pixels within the cropping rectangle, as runs */
+	size_t runs; /* length of the runs, in 32-bit words */
 	struct
 	{
 		int x;
@@ -47,6 +52,7 @@ struct EzSpriteSheetAnimFrame
 		int w;
 		int h;
 	} crop;
+	uint64_t hash; /* hash of the pixels within the cropping rectangle */
 	int ms; /* duration in milliseconds */
 	int isPivotFrame;
 	int isBlank;
@@ -58,7 +64,6 @@ struct EzSpriteSheetAnim
 	struct EzSpriteSheetAnim       *prev;    /* prev in list */
 	struct EzSpriteSheetAnim       *next;    /* next in list */
 	char                           *name;    /* filename */
-	AnimatedImage                  *anim;    /* libwebp animated image */
 	
 	struct EzSpriteSheetAnimFrame  *frame;
 	int                             frameCount;
@@ -66,12 +71,32 @@ struct EzSpriteSheetAnim
 	int                             height;  /* ... and height */
 	
 	int                             foundCrop; /* solved cropping rect */
+	int                             inCache;   /* cache is up to date */
+	
+	struct EzSpriteSheetAnim       *lruPrev; /* resident anims, from least */
+	struct EzSpriteSheetAnim       *lruNext; /* ... to most recently used */
+	int                             pins;    /* users of the pixels */
+	int                             evicted; /* pixels must be reloaded */
+	int                             loading; /* pixels are being reloaded */
+	int                             scratch; /* pixels are in scratch store */
 };
 
 struct EzSpriteSheetAnimList
 {
 	struct EzSpriteSheetAnim *head;
 	int count;
+	
+	/* animations whose pixels are resident, least recently used first;
+	 * once they exceed the budget, unpinned ones are evicted, and are
+	 * reloaded from the cache or the image file when next acquired
+	 */
+	struct EzSpriteSheetAnim *lruHead;
+	struct EzSpriteSheetAnim *lruTail;
+	pthread_mutex_t lock;
+	pthread_cond_t loaded;
+	int64_t resident; /* bytes of pixels resident */
+	int64_t budget; /* bytes (0 = unlimited, nothing is evicted) */
+	char *cache;
 };
 
 /*
@@ -85,6 +110,9 @@ struct EzSpriteSheetAnimList *EzSpriteSheetAnimList_new(void)
 {
 	struct EzSpriteSheetAnimList *s = calloc_safe(1, sizeof(*s));
 	
+	pthread_mutex_init(&s->lock, 0);
+	pthread_cond_init(&s->loaded, 0);
+	
 	return s;
 }
 
@@ -103,9 +131,112 @@ void EzSpriteSheetAnimList_free(struct EzSpriteSheetAnimList **s)
 		EzSpriteSheetAnim_free(&item);
 	}
 	
+	pthread_cond_destroy(&(*s)->loaded);
+	pthread_mutex_destroy(&(*s)->lock);
+	free_safe(&(*s)->cache);
 	free_safe(s);
 }
 
+/* bytes of pixels an animation keeps resident */
+static int64_t EzSpriteSheetAnim_bytes(const struct EzSpriteSheetAnim *s)
+{
+	int64_t bytes = 0;
+	int i;
+	
+	for (i = 0; i < s->frameCount; ++i)
+		bytes += s->frame[i].runs * sizeof(uint32_t);
+	
+	return bytes;
+}
+
+/* drop an animation's pixels, keeping everything else about it */
+static void EzSpriteSheetAnim_dropPixels(struct EzSpriteSheetAnim *s)
+{
+	int i;
+	
+	for (i = 0; i < s->frameCount; ++i)
+		free_safe(&s->frame[i].pixels);
+	
+	s->evicted = 1;
+}
+
+/* the following LRU functions expect list->lock to be held */
+
+/* becomes the most recently used resident animation */
+static void EzSpriteSheetAnimList_lruAppend(struct EzSpriteSheetAnimList *list
+	, struct EzSpriteSheetAnim *s
+)
+{
+	s->lruPrev = list->lruTail;
+	s->lruNext = 0;
+	if (list->lruTail)
+		list->lruTail->lruNext = s;
+	else
+		list->lruHead = s;
+	list->lruTail = s;
+	list->resident += EzSpriteSheetAnim_bytes(s);
+}
+
+/* no longer resident (or about to be appended again) */
+static void EzSpriteSheetAnimList_lruRemove(struct EzSpriteSheetAnimList *list
+	, struct EzSpriteSheetAnim *s
+)
+{
+	if (s->lruPrev)
+		s->lruPrev->lruNext = s->lruNext;
+	else
+		list->lruHead = s->lruNext;
+	if (s->lruNext)
+		s->lruNext->lruPrev = s->lruPrev;
+	else
+		list->lruTail = s->lruPrev;
+	s->lruPrev = s->lruNext = 0;
+	list->resident -= EzSpriteSheetAnim_bytes(s);
+}
+
+/* evict least recently used animations nobody is using until the
+ * pixels left resident fit within the budget (or none can be evicted)
+ */
+static void EzSpriteSheetAnimList_lruTrim(struct EzSpriteSheetAnimList *list)
+{
+	struct EzSpriteSheetAnim *s;
+	struct EzSpriteSheetAnim *next;
+	
+	if (!list->budget)
+		return;
+	
+	for (s = list->lruHead; s && list->resident > list->budget; s = next)
+	{
+		next = s->lruNext;
+		
+		if (s->pins)
+			continue;
+		
+		EzSpriteSheetAnimList_lruRemove(list, s);
+		EzSpriteSheetAnim_dropPixels(s);
+	}
+}
+
+/* limit how many bytes of pixels stay resident (0 = unlimited); when
+ * evicted pixels are needed again, they are read back from the cache
+ * directory if there is one, and decoded from the image file otherwise
+ */
+void EzSpriteSheetAnimList_setBudget(struct EzSpriteSheetAnimList *list
+	, int64_t bytes
+	, const char *cache
+)
+{
+	assert(list);
+	
+	pthread_mutex_lock(&list->lock);
+	free_safe(&list->cache);
+	if (cache)
+		list->cache = strdup_safe(cache);
+	list->budget = (bytes > 0) ? bytes : 0;
+	EzSpriteSheetAnimList_lruTrim(list);
+	pthread_mutex_unlock(&list->lock);
+}
+
 /* add an animation to an animation list */
 struct EzSpriteSheetAnim *EzSpriteSheetAnimList_push(
 	struct EzSpriteSheetAnimList *list
@@ -126,6 +257,14 @@ struct EzSpriteSheetAnim *EzSpriteSheetAnimList_push(
 	list->head = item;
 	list->count += 1;
 	
+	/* account for its pixels */
+	if (!item->evicted && !item->scratch)
+	{
+		pthread_mutex_lock(&list->lock);
+		EzSpriteSheetAnimList_lruAppend(list, item);
+		pthread_mutex_unlock(&list->lock);
+	}
+	
 	return item;
 }
 
@@ -210,13 +349,37 @@ int EzSpriteSheetAnimList_each_findCrop(struct EzSpriteSheetAnimList *list)
 	return 0;
 }
 
+/* returns non-zero if two frames' cropped pixels are identical */
+static int EzSpriteSheetAnimFrame_isIdentical(
+	const struct EzSpriteSheetAnimFrame *a
+	, const struct EzSpriteSheetAnimFrame *b
+)
+{
+	int identical;
+	
+	if (a->crop.w != b->crop.w
+		|| a->crop.h != b->crop.h
+		|| a->runs != b->runs
+		|| a->hash != b->hash
+	)
+		return 0;
+	
+	EzSpriteSheetAnim_acquire(a->anim);
+	EzSpriteSheetAnim_acquire(b->anim);
+	
+	/* the runs of identical pixels are identical */
+	identical = !memcmp(a->pixels, b->pixels, a->runs * sizeof(uint32_t));
+	
+	EzSpriteSheetAnim_release(b->anim);
+	EzSpriteSheetAnim_release(a->anim);
+	
+	return identical;
+}
+
 int EzSpriteSheetAnimFrame_findDuplicates(struct EzSpriteSheetAnimFrame *frame)
 {
 	struct EzSpriteSheetAnimList *list;
 	struct EzSpriteSheetAnim *anim;
-	uint32_t *frameUL;
-	int frameWidth;
-	int stride;
 	
 	assert(frame);
 	assert(frame->anim);
@@ -233,27 +396,15 @@ int EzSpriteSheetAnimFrame_findDuplicates(struct EzSpriteSheetAnimFrame *frame)
 	if (frame->crop.w <= 0 || frame->crop.h <= 0)
 		return 0;
 	
-	/* upper left of pixel data */
-	frameWidth = frame->anim->width;
-	frameUL = frame->pixels;
-	frameUL += frame->crop.y * frameWidth + frame->crop.x;
-	
-	/* length of a row of pixels in bytes */
-	stride = frame->crop.w * 4;
-	
 	/* step through every animation in list */
 	list = frame->anim->list;
 	for (anim = list->head; anim; anim = anim->next)
 	{
 		struct EzSpriteSheetAnimFrame *comp;
-		int compWidth = anim->width;
 		
 		/* step through every frame in every animation */
 		for (comp = anim->frame; comp < anim->frame + anim->frameCount; ++comp)
 		{
-			uint32_t *compUL;
-			int y;
-			
 			/* cannot be duplicate of self */
 			if (comp == frame)
 				continue;
@@ -266,21 +417,8 @@ int EzSpriteSheetAnimFrame_findDuplicates(struct EzSpriteSheetAnimFrame *frame)
 			if (comp->isPivotFrame || comp->isBlank)
 				continue;
 			
-			/* cannot be duplicate if cropping rectangle sizes differ */
-			if (comp->crop.w != frame->crop.w || comp->crop.h != frame->crop.h)
-				continue;
-			
-			/* get upper left of pixel data */
-			compUL = comp->pixels;
-			compUL += comp->crop.y * compWidth + comp->crop.x;
-			
-			/* compare every row */
-			for (y = 0; y < frame->crop.h; ++y)
-				if (memcmp(compUL + y * compWidth, frameUL + y * frameWidth, stride))
-					break;
-			
 			/* every row matched */
-			if (y == frame->crop.h)
+			if (EzSpriteSheetAnimFrame_isIdentical(comp, frame))
 			{
 				/*fprintf(stderr, "dup found frame %d == %d\n"
 					, (int)(comp - anim->frame), (int)(frame - frame->anim->frame)
@@ -294,25 +432,156 @@ int EzSpriteSheetAnimFrame_findDuplicates(struct EzSpriteSheetAnimFrame *frame)
 	return 0;
 }
 
-/* find potential duplicates of each in list */
+/* write each in list to a cache directory, skipping those already there */
+int EzSpriteSheetAnimList_each_writeCache(struct EzSpriteSheetAnimList *list
+	, const char *cache
+)
+{
+	struct EzSpriteSheetAnim *anim;
+	
+	assert(list);
+	assert(cache);
+	
+	if (!list || !cache)
+		return 1;
+	
+	if (dir_make(cache))
+	{
+		complain("failed to create cache directory '%s'", cache);
+		return 1;
+	}
+	
+	for (anim = list->head; anim; anim = anim->next)
+		if (EzSpriteSheetAnim_writeCache(anim, cache))
+			return 1;
+	
+	return 0;
+}
+
+/* find potential duplicates of each in list
+ * 
+ * rather than comparing every frame against every other frame,
+ * each distinct image is entered into a hash table keyed on its
+ * cropping rectangle dimensions and pixel hash; pixels are only
+ * compared when two frames land on the same key
+ * 
+ * among identical frames, the last one in the list is the original,
+ * and every other one is marked as a duplicate of it directly (unlike
+ * EzSpriteSheetAnimFrame_findDuplicates(), which chains them, each
+ * pointing at the next identical frame); frames already marked as
+ * duplicates are left alone, and are never made the original of any
+ */
 int EzSpriteSheetAnimList_each_findDuplicates(struct EzSpriteSheetAnimList *list)
 {
+	struct DupEntry
+	{
+		struct EzSpriteSheetAnimFrame *frame; /* most recent with this image */
+		int next; /* next entry in bucket */
+	} *entry;
 	struct EzSpriteSheetAnim *anim;
+	int *bucket;
+	int bucketCount = 1;
+	int entryCount = 0;
+	int frames = 0;
 	
 	assert(list);
 	
 	if (!list)
 		return 1;
 	
+	for (anim = list->head; anim; anim = anim->next)
+		frames += anim->frameCount;
+	
+	if (!frames)
+		return 0;
+	
+	/* power of two bucket count, keeps load factor at or below 0.5 */
+	while (bucketCount < frames * 2)
+		bucketCount *= 2;
+	bucket = malloc_safe(bucketCount * sizeof(*bucket));
+	memset(bucket, -1, bucketCount * sizeof(*bucket));
+	entry = malloc_safe(frames * sizeof(*entry));
+
+#define KEY(F) (((F)->hash ^ ((F)->hash >> 32) \
+	^ (F)->crop.w * 2654435761u \
+	^ (F)->crop.h * 40503u) & (bucketCount - 1))
+	
+	/* index every frame that can be the original of another */
+	for (anim = list->head; anim; anim = anim->next)
+	{
+		struct EzSpriteSheetAnimFrame *w;
+		
+		for (w = anim->frame; w < anim->frame + anim->frameCount; ++w)
+		{
+			int *link;
+			
+			/* cannot be duplicate of control/blank frame */
+			if (w->isPivotFrame || w->isBlank)
+				continue;
+			
+			/* cannot be duplicate of another duplicate */
+			if (w->isDuplicateOf)
+				continue;
+			
+			/* empty */
+			if (w->crop.w <= 0 || w->crop.h <= 0)
+				continue;
+			
+			/* later frames take the place of earlier identical ones */
+			for (link = bucket + KEY(w); *link >= 0; link = &entry[*link].next)
+			{
+				if (EzSpriteSheetAnimFrame_isIdentical(entry[*link].frame, w))
+				{
+					entry[*link].frame = w;
+					break;
+				}
+			}
+			
+			/* first of its kind */
+			if (*link < 0)
+			{
+				entry[entryCount].frame = w;
+				entry[entryCount].next = -1;
+				*link = entryCount++;
+			}
+		}
+	}
+	
+	/* every frame is a duplicate of whichever identical frame was indexed */
 	for (anim = list->head; anim; anim = anim->next)
 	{
 		struct EzSpriteSheetAnimFrame *w;
 		
 		for (w = anim->frame; w < anim->frame + anim->frameCount; ++w)
-			if (EzSpriteSheetAnimFrame_findDuplicates(w))
-				return 1;
+		{
+			int i;
+			
+			/* already processed */
+			if (w->isDuplicateOf)
+				continue;
+			
+			/* empty */
+			if (w->crop.w <= 0 || w->crop.h <= 0)
+				continue;
+			
+			for (i = bucket[KEY(w)]; i >= 0; i = entry[i].next)
+			{
+				if (EzSpriteSheetAnimFrame_isIdentical(entry[i].frame, w))
+				{
+					/* cannot be duplicate of self */
+					if (entry[i].frame != w)
+						w->isDuplicateOf = entry[i].frame;
+					break;
+				}
+			}
+		}
 	}
 	
+#undef KEY
+
+	free_safe(&bucket);
+	free_safe(&entry);
+	
 	return 0;
 }
 
@@ -343,10 +612,103 @@ int EzSpriteSheetAnimList_each_clearDuplicates(struct EzSpriteSheetAnimList *lis
  * 
  */
 
+/*
+ * each frame's cropped pixels are kept as runs, one row after another:
+ * a count of invisible pixels (which are all 0), a count of visible
+ * pixels, and the visible pixels themselves, over and over until the
+ * counts add up to the width of the cropping rectangle; every count
+ * is 32 bits, so fully visible rows cost two words more than before,
+ * and transparent pixels cost next to nothing
+ */
+
+/* encode a w x h block of pixels as runs; returns the length of the
+ * runs in 32-bit words (if dst is 0, only the length is determined)
+ */
+static size_t runs_encode(uint32_t *dst
+	, const uint32_t *src
+	, int stride
+	, int w
+	, int h
+)
+{
+	size_t n = 0;
+	int y;
+	
+	for (y = 0; y < h; ++y, src += stride)
+	{
+		int x = 0;
+		
+		while (x < w)
+		{
+			int skip = x;
+			int count;
+			
+			while (x < w && !src[x])
+				++x;
+			skip = x - skip;
+			
+			for (count = 0; x < w && src[x]; ++x)
+				++count;
+			
+			if (dst)
+			{
+				dst[n] = skip;
+				dst[n + 1] = count;
+				memcpy(dst + n + 2, src + x - count, count * sizeof(*dst));
+			}
+			n += 2 + count;
+		}
+	}
+	
+	return n;
+}
+
+/* returns non-zero if runs of the given length cover a w x h block */
+static int runs_valid(const uint32_t *run, size_t runs, int w, int h)
+{
+	const uint32_t *end = run + runs;
+	int y;
+	
+	for (y = 0; y < h; ++y)
+	{
+		int64_t x = 0;
+		
+		while (x < w)
+		{
+			if (end - run < 2
+				|| run[0] > w - x
+				|| run[1] > w - x - run[0]
+				|| (size_t)(end - run - 2) < run[1]
+			)
+				return 0;
+			
+			x += run[0] + run[1];
+			run += 2 + run[1];
+		}
+	}
+	
+	return run == end;
+}
+
+/* allocate room for an animation's pixels, in the scratch store if
+ * one is open (scratch pixels are never evicted, the OS pages them)
+ */
+static void *EzSpriteSheetAnim_allocPixels(struct EzSpriteSheetAnim *s
+	, size_t bytes
+)
+{
+	if (s->scratch)
+		return scratch_alloc(bytes);
+	
+	return malloc_safe(bytes);
+}
+
 /* load image from file */
 struct EzSpriteSheetAnim *EzSpriteSheetAnim_new(const char *fn)
 {
 	struct EzSpriteSheetAnim *s = calloc_safe(1, sizeof(*s));
+	AnimatedImage *anim = 0;
+	void *data = 0;
 	int i;
 	
 	assert(fn);
@@ -355,14 +717,14 @@ struct EzSpriteSheetAnim *EzSpriteSheetAnim_new(const char *fn)
 		return 0;
 	
 	s->name = strdup_safe(fn);
+	s->scratch = scratch_isOpen();
 	
 	if (file_is_extension(fn, "webp") || file_is_extension(fn, "gif"))
 	{
 		W_CHAR *wfn = char2wchar(fn);
-		s->anim = calloc_safe(1, sizeof(*s->anim));
-		AnimatedImage *anim = s->anim;
+		anim = calloc_safe(1, sizeof(*anim));
 		
-		if (!ReadAnimatedImage((const char*)wfn, s->anim, 0, NULL))
+		if (!ReadAnimatedImage((const char*)wfn, anim, 0, NULL))
 		{
 			die("Error decoding file: %s", fn);
 			return 0;
@@ -371,7 +733,7 @@ struct EzSpriteSheetAnim *EzSpriteSheetAnim_new(const char *fn)
 		char2wchar_free(&wfn);
 		
 		/* unified animation frame format */
-		s->frameCount = s->anim->num_frames;
+		s->frameCount = anim->num_frames;
 		s->frame = calloc_safe(s->frameCount, sizeof(*s->frame));
 		for (i = 0; i < s->frameCount; ++i)
 		{
@@ -383,7 +745,6 @@ struct EzSpriteSheetAnim *EzSpriteSheetAnim_new(const char *fn)
 	}
 	else
 	{
-		void *data;
 		int c;
 		
 		data = stbi_load(fn, &s->width, &s->height, &c, STBI_rgb_alpha);
@@ -404,24 +765,449 @@ struct EzSpriteSheetAnim *EzSpriteSheetAnim_new(const char *fn)
 	for (i = 0; i < s->frameCount; ++i)
 	{
 		struct EzSpriteSheetAnimFrame *f = s->frame + i;
-		uint8_t *pix8 = f->pixels;
-		int k;
 		
 		f->anim = s;
 		
 		/* mark uninitialized */
 		f->pivot.x = PIVOT_UNSET;
 		f->crop.x = CROP_UNSET;
+	}
+	
+	/* while the pixels are fresh in cache, set invisible pixels of
+	 * each frame to all one color and crop and hash each frame
+	 */
+	EzSpriteSheetAnim_findCrop(s);
+	s->foundCrop = 1;
+	
+	/* keep only the runs of pixels within each cropping rectangle,
+	 * so mostly transparent frames don't hold onto whole canvases
+	 */
+	for (i = 0; i < s->frameCount; ++i)
+	{
+		struct EzSpriteSheetAnimFrame *f = s->frame + i;
+		const uint32_t *canvas = f->pixels;
+		uint32_t *pix32 = 0;
+		
+		f->runs = 0;
 		
-		/* set invisible pixels of each frame to all one color */
-		for (k = 0; k < s->width * s->height; ++k, pix8 += 4)
-			if (!pix8[3])
-				*(uint32_t*)pix8 = 0;
+		if (!f->isBlank)
+		{
+			canvas += f->crop.y * s->width + f->crop.x;
+			f->runs = runs_encode(0, canvas, s->width, f->crop.w, f->crop.h);
+			pix32 = EzSpriteSheetAnim_allocPixels(s, f->runs * sizeof(*pix32));
+			runs_encode(pix32, canvas, s->width, f->crop.w, f->crop.h);
+		}
+		
+		f->pixels = pix32;
 	}
 	
+	/* libwebp cleanup */
+	if (anim)
+	{
+		ClearAnimatedImage(anim);
+		free_safe(&anim);
+	}
+	/* stb_image cleanup */
+	else
+		stbi_image_free(data);
+	
 	return s;
 }
 
+/* every cache file begins with this header
+ * (followed by the path of the image file it describes)
+ */
+struct CacheHeader
+{
+	char     magic[8];
+	int32_t  version;
+	int32_t  pathLength;
+	struct FileStamp stamp; /* image file as it was when cached */
+	int32_t  width;
+	int32_t  height;
+	int32_t  frameCount;
+};
+
+/* followed by the runs of pixels, unless blank */
+struct CacheFrame
+{
+	uint64_t hash;
+	int32_t  ms;
+	int32_t  isBlank;
+	int32_t  crop[4];
+	int64_t  runs;
+};
+
+/* load image and cropping info from a cache directory; returns 0 if
+ * the image file isn't cached, or has changed since it was cached
+ */
+struct EzSpriteSheetAnim *EzSpriteSheetAnim_newFromCache(const char *fn
+	, const char *cache
+)
+{
+	struct EzSpriteSheetAnim *s;
+	struct CacheHeader head;
+	char cachefn[4096];
+	char *path;
+	struct FileStamp stamp;
+	FILE *fp;
+	int i;
+	
+	assert(fn);
+	assert(cache);
+	
+	cache_filename(cachefn, sizeof(cachefn), cache, fn, "ezcache");
+	
+	if (file_stamp(fn, &stamp) || file_stat(cachefn, 0, 0))
+		return 0;
+	
+	/* unreadable (or just removed) cache files are misses, too */
+	if (!(fp = fopen(cachefn, "rb")))
+		return 0;
+	
+	/* confirm the cache file describes this version of this file */
+	if (fread(&head, 1, sizeof(head), fp) != sizeof(head)
+		|| memcmp(head.magic, CACHE_MAGIC, sizeof(head.magic))
+		|| head.version != CACHE_VERSION
+		|| head.pathLength != (int32_t)strlen(fn)
+		|| head.stamp.size != stamp.size
+		|| head.stamp.mtime != stamp.mtime
+		|| head.stamp.ctime != stamp.ctime
+		|| head.stamp.inode != stamp.inode
+		|| head.width <= 0
+		|| head.height <= 0
+		|| head.frameCount <= 0
+	)
+	{
+		fclose_safe(&fp);
+		return 0;
+	}
+	path = malloc_safe(head.pathLength);
+	if (fread(path, 1, head.pathLength, fp) != (size_t)head.pathLength
+		|| memcmp(path, fn, head.pathLength)
+	)
+	{
+		free_safe(&path);
+		fclose_safe(&fp);
+		return 0;
+	}
+	free_safe(&path);
+	
+	s = calloc_safe(1, sizeof(*s));
+	s->name = strdup_safe(fn);
+	s->scratch = scratch_isOpen();
+	s->width = head.width;
+	s->height = head.height;
+	s->frameCount = head.frameCount;
+	s->frame = calloc_safe(s->frameCount, sizeof(*s->frame));
+	s->inCache = 1;
+	s->foundCrop = 1;
+	
+	for (i = 0; i < s->frameCount; ++i)
+	{
+		struct EzSpriteSheetAnimFrame *f = s->frame + i;
+		struct CacheFrame info;
+		uint32_t *pix32;
+		int ok;
+		
+		f->anim = s;
+		f->pivot.x = PIVOT_UNSET;
+		
+		ok = fread(&info, 1, sizeof(info), fp) == sizeof(info);
+		
+		f->hash = info.hash;
+		f->ms = info.ms;
+		f->isBlank = info.isBlank;
+		f->crop.x = info.crop[0];
+		f->crop.y = info.crop[1];
+		f->crop.w = info.crop[2];
+		f->crop.h = info.crop[3];
+		
+		/* truncated or otherwise bogus (no row takes more than
+		 * three words per pixel, which is alternating visibility)
+		 */
+		if (!ok
+			|| f->crop.w < 0
+			|| f->crop.h < 0
+			|| info.runs < 0
+			|| info.runs > (int64_t)f->crop.w * f->crop.h * 3
+			|| (!f->isBlank
+				&& (f->crop.x < 0
+					|| f->crop.y < 0
+					|| f->crop.x + f->crop.w > s->width
+					|| f->crop.y + f->crop.h > s->height
+				)
+			)
+		)
+			goto fail;
+		
+		if (f->isBlank)
+			continue;
+		
+		f->runs = info.runs;
+		f->pixels = pix32 = EzSpriteSheetAnim_allocPixels(s, f->runs * sizeof(*pix32));
+		if (fread(pix32, sizeof(*pix32), f->runs, fp) != f->runs
+			|| !runs_valid(pix32, f->runs, f->crop.w, f->crop.h)
+		)
+			goto fail;
+	}
+	
+	fclose_safe(&fp);
+	
+	return s;
+
+fail:
+	for (i = 0; i < s->frameCount && !s->scratch; ++i)
+		free_safe(&s->frame[i].pixels);
+	free_safe(&s->frame);
+	free_safe(&s->name);
+	free_safe(&s);
+	fclose_safe(&fp);
+	
+	return 0;
+}
+
+/* write one animation's image and cropping info to a cache directory */
+int EzSpriteSheetAnim_writeCache(struct EzSpriteSheetAnim *s
+	, const char *cache
+)
+{
+	struct CacheHeader head = {0};
+	char cachefn[4096];
+	char tmpfn[4096 + 8];
+	FILE *fp;
+	int i;
+	
+	assert(s);
+	assert(cache);
+	
+	/* up to date */
+	if (s->inCache)
+		return 0;
+	
+	/* the cropping rectangles are part of the cache */
+	if (!s->foundCrop)
+		return 1;
+	
+	memcpy(head.magic, CACHE_MAGIC, sizeof(head.magic));
+	head.version = CACHE_VERSION;
+	head.pathLength = strlen(s->name);
+	head.width = s->width;
+	head.height = s->height;
+	head.frameCount = s->frameCount;
+	if (file_stamp(s->name, &head.stamp))
+		return 1;
+	
+	/* write to a temporary file, then rename it, so an interrupted
+	 * write never leaves behind a cache file that looks complete
+	 */
+	cache_filename(cachefn, sizeof(cachefn), cache, s->name, "ezcache");
+	snprintf(tmpfn, sizeof(tmpfn), "%s.tmp", cachefn);
+	if (!(fp = fopen(tmpfn, "wb")))
+	{
+		complain("failed to write cache file '%s'", tmpfn);
+		return 1;
+	}
+	
+	fwrite(&head, 1, sizeof(head), fp);
+	fwrite(s->name, 1, head.pathLength, fp);
+	
+	/* animations yet to be listed haven't been evicted */
+	if (s->list)
+		EzSpriteSheetAnim_acquire(s);
+	
+	for (i = 0; i < s->frameCount; ++i)
+	{
+		struct EzSpriteSheetAnimFrame *f = s->frame + i;
+		struct CacheFrame info = {0};
+		
+		info.hash = f->hash;
+		info.ms = f->ms;
+		info.isBlank = f->isBlank;
+		info.crop[0] = f->crop.x;
+		info.crop[1] = f->crop.y;
+		info.crop[2] = f->crop.w;
+		info.crop[3] = f->crop.h;
+		info.runs = f->runs;
+		
+		fwrite(&info, 1, sizeof(info), fp);
+		
+		if (f->isBlank)
+			continue;
+		
+		fwrite(f->pixels, sizeof(uint32_t), f->runs, fp);
+	}
+	
+	if (s->list)
+		EzSpriteSheetAnim_release(s);
+	
+	/* fclose() flushes, so it can fail to write, too */
+	if (ferror(fp) | fclose(fp))
+	{
+		remove(tmpfn);
+		complain("failed to write cache file '%s'", tmpfn);
+		return 1;
+	}
+	
+	remove(cachefn);
+	if (rename(tmpfn, cachefn))
+	{
+		remove(tmpfn);
+		complain("failed to write cache file '%s'", cachefn);
+		return 1;
+	}
+	
+	s->inCache = 1;
+	
+	return 0;
+}
+
+/* decode an evicted animation's pixels again; nothing else about it
+ * may have changed in the meantime, as it has already been packed
+ */
+static void EzSpriteSheetAnim_reload(struct EzSpriteSheetAnim *s
+	, const char *cache
+)
+{
+	struct EzSpriteSheetAnim *fresh = 0;
+	int i;
+	
+	if (cache)
+		fresh = EzSpriteSheetAnim_newFromCache(s->name, cache);
+	if (!fresh)
+		fresh = EzSpriteSheetAnim_new(s->name);
+	if (!fresh)
+		die("Error reloading file: %s", s->name);
+	
+	if (fresh->frameCount != s->frameCount
+		|| fresh->width != s->width
+		|| fresh->height != s->height
+	)
+		die("'%s' changed while it was being packed", s->name);
+	
+	for (i = 0; i < s->frameCount; ++i)
+	{
+		struct EzSpriteSheetAnimFrame *f = s->frame + i;
+		struct EzSpriteSheetAnimFrame *from = fresh->frame + i;
+		
+		if (from->isBlank != f->isBlank
+			|| (!f->isBlank
+				&& (from->hash != f->hash
+					|| from->crop.x != f->crop.x
+					|| from->crop.y != f->crop.y
+					|| from->crop.w != f->crop.w
+					|| from->crop.h != f->crop.h
+				)
+			)
+		)
+			die("'%s' changed while it was being packed", s->name);
+		
+		f->pixels = from->pixels;
+		f->runs = from->runs;
+		from->pixels = 0;
+	}
+	
+	/* fresh was never linked into a list */
+	free_safe(&fresh->frame);
+	free_safe(&fresh->name);
+	free_safe(&fresh);
+}
+
+/* drop an animation's pixels once they're no longer needed; they are
+ * reloaded when next acquired
+ */
+void EzSpriteSheetAnim_evict(struct EzSpriteSheetAnim *s)
+{
+	struct EzSpriteSheetAnimList *list;
+	
+	assert(s);
+	assert(s->foundCrop);
+	
+	if (s->evicted || s->scratch)
+		return;
+	
+	if (!(list = s->list))
+	{
+		EzSpriteSheetAnim_dropPixels(s);
+		return;
+	}
+	
+	pthread_mutex_lock(&list->lock);
+	if (!s->evicted && !s->pins)
+	{
+		EzSpriteSheetAnimList_lruRemove(list, s);
+		EzSpriteSheetAnim_dropPixels(s);
+	}
+	pthread_mutex_unlock(&list->lock);
+}
+
+/* pin an animation's pixels in memory, reloading them if they were
+ * evicted; safe to call from multiple threads at once, and every call
+ * is paired with a call to EzSpriteSheetAnim_release()
+ */
+void EzSpriteSheetAnim_acquire(struct EzSpriteSheetAnim *s)
+{
+	struct EzSpriteSheetAnimList *list;
+	
+	assert(s);
+	assert(s->list);
+	
+	/* always mapped */
+	if (s->scratch)
+		return;
+	
+	list = s->list;
+	
+	pthread_mutex_lock(&list->lock);
+	
+	s->pins += 1;
+	
+	/* another thread is already reloading them */
+	while (s->loading)
+		pthread_cond_wait(&list->loaded, &list->lock);
+	
+	/* reload without holding the lock, so others can go on meanwhile */
+	if (s->evicted)
+	{
+		s->loading = 1;
+		pthread_mutex_unlock(&list->lock);
+		EzSpriteSheetAnim_reload(s, list->cache);
+		pthread_mutex_lock(&list->lock);
+		s->loading = 0;
+		s->evicted = 0;
+		pthread_cond_broadcast(&list->loaded);
+	}
+	/* becomes the most recently used */
+	else
+		EzSpriteSheetAnimList_lruRemove(list, s);
+	
+	EzSpriteSheetAnimList_lruAppend(list, s);
+	EzSpriteSheetAnimList_lruTrim(list);
+	
+	pthread_mutex_unlock(&list->lock);
+}
+
+/* unpin pixels pinned by EzSpriteSheetAnim_acquire() */
+void EzSpriteSheetAnim_release(struct EzSpriteSheetAnim *s)
+{
+	struct EzSpriteSheetAnimList *list;
+	
+	assert(s);
+	assert(s->list);
+	
+	if (s->scratch)
+		return;
+	
+	assert(s->pins > 0);
+	
+	list = s->list;
+	
+	pthread_mutex_lock(&list->lock);
+	s->pins -= 1;
+	EzSpriteSheetAnimList_lruTrim(list);
+	pthread_mutex_unlock(&list->lock);
+}
+
 /* unlink one animation from the list it's in */
 void EzSpriteSheetAnim_unlink(struct EzSpriteSheetAnim *a)
 {
@@ -453,12 +1239,21 @@ void EzSpriteSheetAnim_unlink(struct EzSpriteSheetAnim *a)
 		next->prev = prev;
 	
 	list->count -= 1;
+	
+	/* its pixels no longer count toward the budget */
+	if (!a->evicted && !a->scratch)
+	{
+		pthread_mutex_lock(&list->lock);
+		EzSpriteSheetAnimList_lruRemove(list, a);
+		pthread_mutex_unlock(&list->lock);
+	}
 }
 
 /* free a struct allocated using EzSpriteSheetAnim_new */
 void EzSpriteSheetAnim_free(struct EzSpriteSheetAnim **s)
 {
 	struct EzSpriteSheetAnim *a;
+	int i;
 	
 	if (!s || !*s)
 		return;
@@ -470,16 +1265,9 @@ void EzSpriteSheetAnim_free(struct EzSpriteSheetAnim **s)
 	if (a->name)
 		free_safe(&a->name);
 	
-	/* libwebp cleanup */
-	if (a->anim)
-	{
-		ClearAnimatedImage(a->anim);
-		free_safe(&a->anim);
-	}
-	/* stb_image cleanup */
-	else
-		stbi_image_free(a->frame[0].pixels);
-	
+	/* scratch space is reclaimed only when the store is closed */
+	for (i = 0; i < a->frameCount && !a->scratch; ++i)
+		free_safe(&a->frame[i].pixels);
 	free_safe(&a->frame);
 	
 	free_safe(s);
@@ -565,6 +1353,8 @@ int EzSpriteSheetAnim_findPivot(struct EzSpriteSheetAnim *s
 	if (s->frameCount == 1)
 		return 0;
 	
+	EzSpriteSheetAnim_acquire(s);
+	
 	/* optimization: only the last frame can be an pivot frame
 	 * (this is now part of the spec)
 	 */
@@ -576,12 +1366,8 @@ int EzSpriteSheetAnim_findPivot(struct EzSpriteSheetAnim *s
 			uint8_t rgba[4];
 			uint32_t word;
 		} c;
-		int frameWidth = s->width;
 		int y;
 		
-		/* optimization: scan only the cropping rectangle */
-		pix32 += f->crop.y * frameWidth + f->crop.x;
-		
 		c.rgba[0] = color >> 16;
 		c.rgba[1] = color >> 8;
 		c.rgba[2] = color;
@@ -589,54 +1375,73 @@ int EzSpriteSheetAnim_findPivot(struct EzSpriteSheetAnim *s
 		
 		f->pivot.x = PIVOT_UNSET;
 		
-		for (y = 0; y < f->crop.h; ++y, pix32 += frameWidth)
+		/* blank frames have no pixels to scan */
+		if (f->isBlank)
+			continue;
+		
+		for (y = 0; y < f->crop.h; ++y)
 		{
-			int x;
+			int x = 0;
 			
-			for (x = 0; x < f->crop.w; ++x)
+			while (x < f->crop.w)
 			{
-				int j;
+				uint32_t count;
 				
-				/* skip pixels that don't match */
-				if (pix32[x] != c.word)
-					continue;
-				
-				/* pivot was already determined from another pixel */
-				if (f->pivot.x != PIVOT_UNSET)
-				{
-					complain(
-						"'%s' frame %d/%d has multiple pixels of pivot color #%06x!"
-						, s->name
-						, i + 1
-						, s->frameCount
-						, color
-					);
-					return 1;
-				}
-				f->pivot.x = x + f->crop.x;
-				f->pivot.y = y + f->crop.y;
-				f->isPivotFrame = 1;
+				/* invisible pixels can't be the pivot color */
+				x += pix32[0];
+				count = pix32[1];
+				pix32 += 2;
 				
-				/* pivot pixel specifies pivot of all preceding frames */
-				for (j = i - 1; j >= 0; --j)
+				for (; count; --count, ++x, ++pix32)
 				{
-					struct EzSpriteSheetAnimFrame *prev = s->frame + j;
+					int j;
 					
-					/* accounts for multiple pivot frames */
-					if (prev->pivot.x != PIVOT_UNSET)
-						break;
+					/* skip pixels that don't match */
+					if (*pix32 != c.word)
+						continue;
 					
-					prev->pivot.x = f->pivot.x;
-					prev->pivot.y = f->pivot.y;
+					/* pivot was already determined from another pixel */
+					if (f->pivot.x != PIVOT_UNSET)
+					{
+						complain(
+							"'%s' frame %d/%d has multiple pixels of pivot color #%06x!"
+							, s->name
+							, i + 1
+							, s->frameCount
+							, color
+						);
+						EzSpriteSheetAnim_release(s);
+						return 1;
+					}
+					f->pivot.x = x + f->crop.x;
+					f->pivot.y = y + f->crop.y;
+					f->isPivotFrame = 1;
+					
+					/* pivot pixel specifies pivot of all preceding frames */
+					for (j = i - 1; j >= 0; --j)
+					{
+						struct EzSpriteSheetAnimFrame *prev = s->frame + j;
+						
+						/* accounts for multiple pivot frames */
+						if (prev->pivot.x != PIVOT_UNSET)
+							break;
+						
+						prev->pivot.x = f->pivot.x;
+						prev->pivot.y = f->pivot.y;
+					}
 				}
 			}
 		}
 	}
 	
+	EzSpriteSheetAnim_release(s);
+	
 	return 0;
 }
 
-/* determine cropping rectangle of all frames within one animation */
+/* determine cropping rectangle of all frames within one animation
+ * (also sets invisible pixels to all one color and hashes each frame)
+ */
 int EzSpriteSheetAnim_findCrop(struct EzSpriteSheetAnim *s)
 {
 	int i;
@@ -646,69 +1451,20 @@ int EzSpriteSheetAnim_findCrop(struct EzSpriteSheetAnim *s)
 	if (!s)
 		return 1;
 	
+	/* once cropped, only the cropped pixels remain */
+	if (s->foundCrop)
+		return 0;
+	
 	for (i = 0; i < s->frameCount; ++i)
 	{
 		struct EzSpriteSheetAnimFrame *f = s->frame + i;
-		const uint32_t *pix32 = f->pixels;
-		int pixNum = s->width * s->height;
-		int upper = -1;
-		int lower = -1;
-		int left = s->width;
-		int right = -1;
-		int k;
 		
 		f->crop.x = CROP_UNSET;
-		f->isBlank = 0;
-		
-		/* get uppermost pixel */
-		for (k = 0; k < pixNum; ++k)
-			if (pix32[k])
-			{
-				upper = k / s->width;
-				break;
-			}
-		
-		/* optimization: blank frame */
-		if (k == pixNum)
-		{
-			f->isBlank = 1;
-			continue;
-		}
-		
-		/* get lowermost pixel */
-		for (k = pixNum - 1; k >= 0; --k)
-			if (pix32[k])
-			{
-				lower = (k / s->width) + 1;
-				break;
-			}
-		
-		/* get leftmost and rightmost pixels */
-		for (k = upper * s->width; k < lower * s->width; ++k)
-		{
-			int x;
-			
-			if (!pix32[k])
-				continue;
-			
-			x = k % s->width;
-			
-			if (x < left)
-				left = x;
-			
-			if (x >= right)
-				right = x + 1;
-		}
-		
-		assert(upper >= 0 && upper <= s->height);
-		assert(lower >= 0 && lower <= s->height);
-		assert(right >= 0 && right <= s->width);
-		assert(left  >= 0 && left  <= s->width);
-		
-		f->crop.x = left;
-		f->crop.y = upper;
-		f->crop.w = right - left;
-		f->crop.h = lower - upper;
+		f->hash = 0;
+		f->isBlank = analyze_frame(f->pixels, s->width, s->height
+			, &f->crop.x, &f->crop.y, &f->crop.w, &f->crop.h
+			, &f->hash
+		);
 	}
 	
 	return 0;
@@ -746,6 +1502,16 @@ const struct EzSpriteSheetAnimFrame *EzSpriteSheetAnimFrame_get_isDuplicateOf(
 	return frame;
 }
 
+/* get the animation a frame belongs to */
+struct EzSpriteSheetAnim *EzSpriteSheetAnimFrame_get_anim(
+	const struct EzSpriteSheetAnimFrame *frame
+)
+{
+	assert(frame);
+	
+	return frame->anim;
+}
+
 /* gets clipping rectangle of a frame graphic */
 void EzSpriteSheetAnimFrame_get_crop(
 	const struct EzSpriteSheetAnimFrame *frame
@@ -815,13 +1581,42 @@ int EzSpriteSheetAnimFrame_get_height(const struct EzSpriteSheetAnimFrame *frame
 	return frame->anim->height;
 }
 
-const void *EzSpriteSheetAnimFrame_get_pixels(
+/* draw the pixels within the cropping rectangle into dst, which is
+ * dstStride pixels wide, clearing the invisible ones as it goes
+ * (only valid while the frame's animation is acquired)
+ */
+void EzSpriteSheetAnimFrame_blit(
 	const struct EzSpriteSheetAnimFrame *frame
+	, void *dst
+	, int dstStride
 )
 {
+	const uint32_t *run;
+	uint32_t *row = dst;
+	int y;
+	
 	assert(frame);
+	assert(dst);
+	
+	if (frame->isBlank)
+		return;
 	
-	return frame->pixels;
+	for (run = frame->pixels, y = 0; y < frame->crop.h; ++y, row += dstStride)
+	{
+		uint32_t *d = row;
+		uint32_t *end = row + frame->crop.w;
+		
+		while (d < end)
+		{
+			uint32_t skip = run[0];
+			uint32_t count = run[1];
+			
+			memset(d, 0, skip * sizeof(*d));
+			memcpy(d + skip, run + 2, count * sizeof(*d));
+			d += skip + count;
+			run += 2 + count;
+		}
+	}
 }
 
 int EzSpriteSheetAnimFrame_get_ms(
@@ -11,31 +11,45 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "common.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #include <wchar.h>
+#include <direct.h>
 #endif
 
 #define ERRMSG_NO_MORE_MEMORY "ran out of memory"
 
+/* messages may come from worker threads, so each line is written
+ * in one piece, and popups are shown by the thread that started the
+ * workers (GUI message boxes can only be shown from that thread)
+ */
 #define QUICKOUT(PREFIX, HANDLE, OVERLOAD) if (HANDLE) { \
+	pthread_mutex_lock(&quickout_lock); \
 	fprintf(HANDLE, "[" PREFIX "] "); \
 		va_start(ap, fmt); \
 		vfprintf(HANDLE, fmt, ap); \
 		va_end(ap); \
 	fprintf(HANDLE,"\n"); \
+	pthread_mutex_unlock(&quickout_lock); \
 } \
 if (OVERLOAD) { \
-	static char buf[1024]; \
+	char buf[1024]; \
 		va_start(ap, fmt); \
 		vsnprintf(buf, sizeof(buf), fmt, ap); \
 		va_end(ap); \
-	OVERLOAD(buf); \
+	if (!worker_defer(OVERLOAD, buf)) \
+		OVERLOAD(buf); \
 }
 
+static pthread_mutex_t quickout_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static FILE *logfile = 0;
 static int logfile_only_warnings = 0;
 
@@ -90,10 +104,13 @@ void die(const char *fmt, ...)
 {
 	va_list ap;
 	
-	if (!fmt)
-		exit(EXIT_FAILURE);
+	if (fmt)
+	{
+		QUICKOUT("!", logfile, die_overload);
+	}
 	
-	QUICKOUT("!", logfile, die_overload);
+	/* worker threads leave exiting to the thread that started them */
+	worker_abandon();
 	
 	logfile_close();
 	
@@ -303,6 +320,141 @@ void *char2wchar(const char *fn)
 #endif
 }
 
+/* get a file's size and modification time; returns non-zero on failure */
+int file_stat(const char *fn, int64_t *size, int64_t *mtime)
+{
+	int rval;
+	
+	assert(fn);
+
+#if defined(_WIN32) && (defined(_UNICODE) || defined(UNICODE))
+	struct _stat64 st;
+	WCHAR *wfn = char2wchar(fn);
+	rval = _wstat64(wfn, &st);
+	char2wchar_free(&wfn);
+#else
+	struct stat st;
+	rval = stat(fn, &st);
+#endif
+
+	if (rval)
+		return 1;
+	
+	if (size)
+		*size = st.st_size;
+	if (mtime)
+		*mtime = st.st_mtime;
+	
+	return 0;
+}
+
+/* get a file's size, inode, and modification and status change times
+ * (to the nanosecond, where the file system allows), so a file that's
+ * rewritten within the same second can still be told apart from the
+ * original; returns non-zero on failure
+ */
+int file_stamp(const char *fn, struct FileStamp *stamp)
+{
+	assert(fn);
+	assert(stamp);
+
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	#if defined(_UNICODE) || defined(UNICODE)
+	WCHAR *wfn = char2wchar(fn);
+	BOOL ok = GetFileAttributesExW(wfn, GetFileExInfoStandard, &attr);
+	char2wchar_free(&wfn);
+	#else
+	BOOL ok = GetFileAttributesExA(fn, GetFileExInfoStandard, &attr);
+	#endif
+	
+	if (!ok)
+		return 1;
+	
+	/* FILETIMEs count 100 nanosecond intervals */
+	#define FILETIME_NS(X) \
+		(int64_t)((((uint64_t)(X).dwHighDateTime << 32) | (X).dwLowDateTime) * 100)
+	stamp->size = ((int64_t)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+	stamp->mtime = FILETIME_NS(attr.ftLastWriteTime);
+	stamp->ctime = FILETIME_NS(attr.ftCreationTime);
+	stamp->inode = 0;
+	#undef FILETIME_NS
+#else
+	struct stat st;
+	
+	if (stat(fn, &st))
+		return 1;
+	
+	#ifdef __APPLE__
+		#define TIMESPEC_NS(X) ((int64_t)st.X##spec.tv_sec * 1000000000 + st.X##spec.tv_nsec)
+	#else
+		#define TIMESPEC_NS(X) ((int64_t)st.X.tv_sec * 1000000000 + st.X.tv_nsec)
+	#endif
+	stamp->size = st.st_size;
+	stamp->mtime = TIMESPEC_NS(st_mtim);
+	stamp->ctime = TIMESPEC_NS(st_ctim);
+	stamp->inode = st.st_ino;
+	#undef TIMESPEC_NS
+#endif
+
+	return 0;
+}
+
+/* FNV-1a, for deriving keys and file names from strings */
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t n)
+{
+	const uint8_t *c = data;
+	
+	while (n--)
+	{
+		hash ^= *c++;
+		hash *= 0x100000001b3;
+	}
+	
+	return hash;
+}
+
+/* derive the name of a file in the cache directory; the cache is a
+ * flat directory of files named after a hash of what they describe
+ * (such as an image's path) and suffixed with what they contain
+ */
+void cache_filename(char *dst, size_t n
+	, const char *cache
+	, const char *name
+	, const char *ext
+)
+{
+	uint64_t hash = hash_bytes(HASH_BASIS, name, strlen(name));
+	
+	assert(cache);
+	assert(ext);
+	
+	snprintf(dst, n, "%s/%016llx.%s", cache, (unsigned long long)hash, ext);
+}
+
+/* create a directory if it doesn't already exist;
+ * returns non-zero if it doesn't exist and couldn't be created
+ */
+int dir_make(const char *path)
+{
+	assert(path);
+	
+	if (!file_stat(path, 0, 0))
+		return 0;
+
+#if defined(_WIN32) && (defined(_UNICODE) || defined(UNICODE))
+	WCHAR *wpath = char2wchar(path);
+	int rval = _wmkdir(wpath);
+	char2wchar_free(&wpath);
+#elif defined(_WIN32)
+	int rval = _mkdir(path);
+#else
+	int rval = mkdir(path, 0777);
+#endif
+
+	return rval != 0;
+}
+
 int file_is_extension(const char *fn, const char *ext)
 {
 	/* also handles unlikely cases like "/home/username/.png/none" */
@@ -25,6 +25,15 @@ struct EzSpriteSheetRectList;
 struct File;
 struct FileList;
 
+/* enough about a file to tell whether it has changed */
+struct FileStamp
+{
+	int64_t size;
+	int64_t mtime; /* nanoseconds */
+	int64_t ctime; /* nanoseconds (creation time on win32) */
+	int64_t inode; /* 0 on win32 */
+};
+
 /* common */
 FILE *fopen_safe(const char *fn, const char *mode);
 void fclose_safe(FILE **fp);
@@ -49,6 +58,16 @@ void *char2wchar(const char *fn);
 void (char2wchar_free)(void **ptr);
 #define char2wchar_free(X) (char2wchar_free)((void**)X)
 int file_is_extension(const char *fn, const char *ext);
+int file_stat(const char *fn, int64_t *size, int64_t *mtime);
+int file_stamp(const char *fn, struct FileStamp *stamp);
+int dir_make(const char *path);
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t n);
+#define HASH_BASIS 0xcbf29ce484222325
+void cache_filename(char *dst, size_t n
+	, const char *cache
+	, const char *name
+	, const char *ext
+);
 char *(my_strndup)(const char *s, size_t n);
 char *(my_strcasestr)(const char *haystack, const char *needle);
 //#define my_strndup strndup
@@ -65,6 +84,53 @@ struct FileList *FileList_new(const char *path);
 void FileList_free(struct FileList **list_);
 int FileList_get_count(struct FileList *list);
 
+/* worker */
+int worker_count(void);
+int64_t worker_clock(void);
+void worker_run(int jobs
+	, int count
+	, void each(void *udata, int index)
+	, void *udata
+	, void progress(float unit_interval)
+);
+int worker_defer(void popup(const char *msg), const char *msg);
+void worker_abandon(void);
+
+/* scratch */
+void scratch_open(const char *fn);
+void scratch_close(void);
+int scratch_isOpen(void);
+void *scratch_alloc(size_t bytes);
+
+/* png */
+void png_write(const char *fn, const void *rgba, int w, int h, int level, int jobs);
+
+/* texture */
+enum EzSpriteSheetTexture
+{
+	EzSpriteSheetTexture_Png /* no block compression */
+	, EzSpriteSheetTexture_Bc1 /* DXT1, 1-bit alpha */
+	, EzSpriteSheetTexture_Bc3 /* DXT5, interpolated alpha */
+};
+void texture_write(const char *fn
+	, const void *rgba
+	, int w
+	, int h
+	, enum EzSpriteSheetTexture format
+	, int jobs
+);
+
+/* analyze */
+int analyze_frame(void *rgba
+	, int width
+	, int height
+	, int *cropX
+	, int *cropY
+	, int *cropW
+	, int *cropH
+	, uint64_t *hash
+);
+
 /* animation */
 const struct EzSpriteSheetAnimFrame *EzSpriteSheetAnim_get_lastframe(
 	const struct EzSpriteSheetAnim *anim
@@ -80,13 +146,32 @@ struct EzSpriteSheetAnim *EzSpriteSheetAnimList_push(
 	, struct EzSpriteSheetAnim *item
 );
 struct EzSpriteSheetAnim *EzSpriteSheetAnim_new(const char *fn);
+struct EzSpriteSheetAnim *EzSpriteSheetAnim_newFromCache(const char *fn
+	, const char *cache
+);
+int EzSpriteSheetAnim_writeCache(struct EzSpriteSheetAnim *s
+	, const char *cache
+);
+int EzSpriteSheetAnimList_each_writeCache(struct EzSpriteSheetAnimList *list
+	, const char *cache
+);
 void EzSpriteSheetAnim_free(struct EzSpriteSheetAnim **s);
+void EzSpriteSheetAnimList_setBudget(struct EzSpriteSheetAnimList *list
+	, int64_t bytes
+	, const char *cache
+);
+void EzSpriteSheetAnim_evict(struct EzSpriteSheetAnim *s);
+void EzSpriteSheetAnim_acquire(struct EzSpriteSheetAnim *s);
+void EzSpriteSheetAnim_release(struct EzSpriteSheetAnim *s);
 struct EzSpriteSheetAnimFrame *EzSpriteSheetAnim_each_frame(
 	struct EzSpriteSheetAnim *s
 );
 struct EzSpriteSheetAnim *EzSpriteSheetAnim_get_next(
 	struct EzSpriteSheetAnim *anim
 );
+struct EzSpriteSheetAnim *EzSpriteSheetAnimFrame_get_anim(
+	const struct EzSpriteSheetAnimFrame *frame
+);
 void EzSpriteSheetAnimFrame_get_crop(
 	const struct EzSpriteSheetAnimFrame *frame
 	, int *x, int *y, int *w, int *h
@@ -96,8 +181,10 @@ void EzSpriteSheetAnimFrame_set_udata(struct EzSpriteSheetAnimFrame *frame
 );
 int EzSpriteSheetAnimFrame_get_width(const struct EzSpriteSheetAnimFrame *frame);
 int EzSpriteSheetAnimFrame_get_height(const struct EzSpriteSheetAnimFrame *frame);
-const void *EzSpriteSheetAnimFrame_get_pixels(
+void EzSpriteSheetAnimFrame_blit(
 	const struct EzSpriteSheetAnimFrame *frame
+	, void *dst
+	, int dstStride
 );
 int EzSpriteSheetAnimFrame_get_isPivotFrame(
 	const struct EzSpriteSheetAnimFrame *frame
@@ -131,6 +218,20 @@ enum EzSpriteSheetRectPack
 {
 	EzSpriteSheetRectPack_MaxRects
 	, EzSpriteSheetRectPack_Guillotine
+	, EzSpriteSheetRectPack_Skyline
+	, EzSpriteSheetRectPack_SkylineWasteMap /* recovers space under the skyline */
+};
+enum EzSpriteSheetRectFit
+{
+	EzSpriteSheetRectFit_None /* fill one page at a time */
+	, EzSpriteSheetRectFit_First /* all pages open, first one that fits */
+	, EzSpriteSheetRectFit_Best /* all pages open, fullest one that fits */
+};
+enum EzSpriteSheetRectShrink
+{
+	EzSpriteSheetRectShrink_None
+	, EzSpriteSheetRectShrink_Last /* only the last page */
+	, EzSpriteSheetRectShrink_All
 };
 int EzSpriteSheetAnimList_each_findPivot(struct EzSpriteSheetAnimList *list
 	, const uint32_t color
@@ -160,6 +261,56 @@ void EzSpriteSheetRectList_pack(struct EzSpriteSheetRectList *s
 	, int exhaustive
 	, void progress(float unit_interval)
 );
+void EzSpriteSheetRectList_setHeuristic(struct EzSpriteSheetRectList *s
+	, int choice
+	, int split
+);
+int EzSpriteSheetRectList_alignUp(const struct EzSpriteSheetRectList *s, int size);
+void EzSpriteSheetRectList_setAlign(struct EzSpriteSheetRectList *s, int align);
+void EzSpriteSheetRectList_setMargin(struct EzSpriteSheetRectList *s, int margin);
+void EzSpriteSheetRectList_setFit(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectFit fit
+);
+void EzSpriteSheetRectList_packBest(struct EzSpriteSheetRectList *s
+	, int width
+	, int height
+	, int rotate
+	, int exhaustive
+	, int jobs
+	, void progress(float unit_interval)
+);
+void EzSpriteSheetRectList_findArea(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectPack mode
+	, int maxWidth
+	, int maxHeight
+	, int rotate
+	, int exhaustive
+	, int jobs
+	, int *width
+	, int *height
+);
+int EzSpriteSheetRectList_optimize(struct EzSpriteSheetRectList *s
+	, int ms
+	, uint64_t seed
+	, int replay
+	, int jobs
+	, void progress(float unit_interval)
+);
+int EzSpriteSheetRectList_packIncremental(struct EzSpriteSheetRectList *s
+	, const struct EzSpriteSheetRectList *prev
+	, float threshold
+	, void progress(float unit_interval)
+);
+int EzSpriteSheetRectList_writeLayout(const struct EzSpriteSheetRectList *s
+	, const char *fn
+	, uint64_t signature
+);
+struct EzSpriteSheetRectList *EzSpriteSheetRectList_readLayout(const char *fn
+	, uint64_t signature
+);
+void EzSpriteSheetRectList_shrink(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectShrink mode
+);
 void EzSpriteSheetRectList_free(struct EzSpriteSheetRectList **s);
 void EzSpriteSheetRectList_pageDebugOverlay(struct EzSpriteSheetRectList *s
 	, int page, void *p_, int w, int h, uint8_t opacity
@@ -178,6 +329,7 @@ void *EzSpriteSheetRectList_page(struct EzSpriteSheetRectList *s
 void EzSpriteSheetRectList_get_biggest_page(struct EzSpriteSheetRectList *s
 	, int *w, int *h
 );
+void EzSpriteSheetRect_set_key(struct EzSpriteSheetRect *s, uint64_t key);
 int EzSpriteSheetRect_get_page(const struct EzSpriteSheetRect *s);
 int EzSpriteSheetRect_get_rotated(const struct EzSpriteSheetRect *s);
 void EzSpriteSheetRect_get_crop(
@@ -12,16 +12,6 @@
 #include <assert.h>
 #include <stdio.h>
 
-/* for writing PNGs */
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-	#if defined(_WIN32) && (defined(_UNICODE) || defined(UNICODE))
-		#define STBIW_WINDOWS_UTF8
-	#endif
-	#define STBIW_MALLOC malloc_safe
-	#define STBIW_REALLOC realloc_safe
-	#define STBIW_FREE free
-#include "stb_image_write.h"
-
 /* private */
 static char *writing_filename = 0; /* path to file being written */
 
@@ -29,6 +19,8 @@ static char *writing_filename = 0; /* path to file being written */
 FILE *Exporter__out = 0;   /* file handle for writing data */
 char *Exporter__path = 0;  /* directory containing output file */
 char *Exporter__name = 0;  /* out filename w/o directory or extension */
+const char *Exporter__extension = "png"; /* of sheet images */
+enum EzSpriteSheetTexture Exporter__texture = 0; /* sheet image format */
 
 /* bindings */
 extern const struct Exporter Exporter__xml;
@@ -54,7 +46,10 @@ static char *sanitize_path(const char *dirty)
 }
 
 /* select export mode */
-const struct Exporter *Export_begin(const char *name, const char *outfnDirty)
+const struct Exporter *Export_begin(const char *name
+	, const char *outfnDirty
+	, enum EzSpriteSheetTexture texture
+)
 {
 	const char *longname;
 	const struct Exporter *arr[] =
@@ -69,6 +64,10 @@ const struct Exporter *Export_begin(const char *name, const char *outfnDirty)
 	
 	assert(name);
 	
+	/* sheet image format */
+	Exporter__texture = texture;
+	Exporter__extension = (texture == EzSpriteSheetTexture_Png) ? "png" : "dds";
+	
 	/* combo box expanded format e.g. 'C99 Header (.h)(*.h)' */
 	longname = strstr(name, " (");
 	
@@ -183,6 +182,21 @@ const struct Exporter *Export_begin(const char *name, const char *outfnDirty)
 	return e;
 }
 
+/* write a sheet's pixels to '<path><name>-<index>.<extension>' using
+ * 'jobs' threads ('level' is the PNG compression level); this only
+ * reads the exporter's globals, so pages can be written concurrently
+ */
+void Export_sheet(int index, const void *rgba, int w, int h, int level, int jobs)
+{
+	char source[1024];
+	
+	snprintf(source, sizeof(source), "%s%s-%d.%s", Exporter__path, Exporter__name, index, Exporter__extension);
+	if (Exporter__texture == EzSpriteSheetTexture_Png)
+		png_write(source, rgba, w, h, level, jobs);
+	else
+		texture_write(source, rgba, w, h, Exporter__texture, jobs);
+}
+
 void Export_end(void)
 {
 	if (Exporter__path)
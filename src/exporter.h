@@ -9,7 +9,7 @@
 #define EZSPRITESHEET_EXPORTER_H_INCLUDED
 
 #include <stdio.h>
-#include "stb_image_write.h"
+#include "common.h"
 
 struct Exporter
 {
@@ -37,7 +37,11 @@ struct Exporter
 	} frame;
 };
 
-const struct Exporter *Export_begin(const char *name, const char *outfnDirty);
+const struct Exporter *Export_begin(const char *name
+	, const char *outfnDirty
+	, enum EzSpriteSheetTexture texture
+);
+void Export_sheet(int index, const void *rgba, int w, int h, int level, int jobs);
 void Export_end(void);
 
 #endif /* EZSPRITESHEET_EXPORTER_H_INCLUDED */
@@ -16,7 +16,6 @@
  */
 static int indent = 0;
 
-#define UNUSED(X) (void)X;
 #define OPEN_ONE { P("{\n"); ++indent; }
 #define CLOSE_ONE { --indent; P((isLast) ? "}\n" : "},\n"); }
 #define GENERIC_ISFIRST(X, Z) \
@@ -124,20 +123,19 @@ static void capsule_end(int sheets, int animations, int isFirst, int isLast)
 
 static void sheet_begin(int index, const void *rgba, int w, int h, int isFirst, int isLast)
 {
-	extern char *Exporter__path;
 	extern char *Exporter__name;
+	extern const char *Exporter__extension;
 	char source[1024];
 	
 	GENERIC_ISFIRST("sheet", EzSpriteSheet);
 	OPEN_ONE;
 	
-	snprintf(source, sizeof(source), "%s%s-%d.png", Exporter__path, Exporter__name, index);
-	stbi_write_png(source, w, h, 4, rgba, w * 4);
-	snprintf(source, sizeof(source), "%s-%d.png", Exporter__name, index);
+	snprintf(source, sizeof(source), "%s-%d.%s", Exporter__name, index, Exporter__extension);
 	P("\"%s\",\n", source);
 	P("%d,\n", w);
 	P("%d\n", h);
 	
+	UNUSED(rgba);
 	UNUSED(isLast);
 };
 
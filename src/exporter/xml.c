@@ -16,8 +16,6 @@
  */
 static int indent = 0;
 
-#define UNUSED(X) (void)X;
-
 static void P(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
 static void P(const char *fmt, ...)
 {
@@ -58,15 +56,14 @@ static void capsule_end(int sheets, int animations, int isFirst, int isLast)
 
 static void sheet_begin(int index, const void *rgba, int w, int h, int isFirst, int isLast)
 {
-	extern char *Exporter__path;
 	extern char *Exporter__name;
+	extern const char *Exporter__extension;
 	char source[1024];
 	
-	snprintf(source, sizeof(source), "%s%s-%d.png", Exporter__path, Exporter__name, index);
-	stbi_write_png(source, w, h, 4, rgba, w * 4);
-	snprintf(source, sizeof(source), "%s-%d.png", Exporter__name, index);
+	snprintf(source, sizeof(source), "%s-%d.%s", Exporter__name, index, Exporter__extension);
 	P("<sheet index=\"%d\" width=\"%d\" height=\"%d\" source=\"%s\"", index, w, h, source);
 	++indent;
+	UNUSED(rgba);
 	UNUSED(isFirst);
 	UNUSED(isLast);
 };
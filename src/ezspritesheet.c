@@ -49,6 +49,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <time.h>
 #include "common.h"
 #include "program.h"
 #include "exporter.h"
@@ -66,6 +67,14 @@
 #define OFFSTR "off"
 #define ONSTR "on"
 #define BOOL_ON_OFF(X) (X) ? ONSTR : OFFSTR
+#define PNG_LEVEL_DEFAULT 6 /* as much effort as stb_image_write spends */
+
+/* a reusable buffer for baking pages into */
+struct PageBuffer
+{
+	void *pix;
+	unsigned maxpix;
+};
 
 /* globals help reduce verbosity here */
 static struct
@@ -77,6 +86,8 @@ static struct
 	char *input;
 	char *output;
 	char *logfile;
+	char *cache;
+	char *scratch; /* file decoded pixels are mapped from (0 = off) */
 	int warnings;
 	int quiet;
 	int exhaustive;
@@ -89,17 +100,36 @@ static struct
 	int height;
 	int negate;
 	int hasRegex;
+	int jobs;
+	int64_t memory; /* bytes of decoded pixels kept resident (0 = all) */
+	int pngLevel; /* 0 = store only ... 9 = smallest */
+	int gutter; /* neighbours share one pad's width of border */
+	int gutterPacked; /* used by current rectList */
+	int align; /* placement alignment in pixels (0 = off) */
+	int alignPacked; /* used by current rectList */
+	enum EzSpriteSheetTexture texture;
+	int autoArea; /* width and height are the maximum */
+	int autoAreaPacked; /* used by current rectList */
+	int incremental; /* fill threshold percentage (0 = off) */
+	uint64_t layoutSignature; /* settings current rectList was packed with */
+	int optimize; /* optimizer time budget in milliseconds (0 = off) */
+	int optimizePacked; /* used by current rectList */
+	int replay; /* optimizer trial to reproduce (-1 = search) if seeded */
+	int replayPacked;
+	uint64_t seed;
+	int seeded; /* seed was provided, so it isn't chosen per run */
+	uint64_t seedPacked;
+	enum EzSpriteSheetRectFit fit;
+	enum EzSpriteSheetRectFit fitPacked; /* used by current rectList */
+	enum EzSpriteSheetRectShrink shrink;
+	enum EzSpriteSheetRectShrink shrinkPacked; /* used by current rectList */
 	uint32_t color;
 	struct EzSpriteSheetAnimList *animList;
 	struct EzSpriteSheetRectList *rectList;
 	struct FileList *fileList;
-	struct
-	{
-		void *pix;
-		unsigned maxpix;
-	} page;
+	struct PageBuffer page;
 	regex_t regex;
-} g = {0};
+} g = { .pngLevel = PNG_LEVEL_DEFAULT };
 
 #define rectList g.rectList /* hello lazy */
 #define animList g.animList
@@ -150,6 +180,45 @@ static void get_crop(
 	}
 }
 
+/* identifies a sprite across runs: its file path and frame index */
+static uint64_t frame_key(const char *name, int index)
+{
+	uint64_t hash = hash_bytes(HASH_BASIS, name, strlen(name));
+	
+	return hash_bytes(hash, &index, sizeof(index));
+}
+
+/* identifies the settings that determine where sprites are placed,
+ * so a previous layout is only reused when packing the same way
+ */
+static uint64_t layout_signature(const char *method)
+{
+	char buf[1024];
+	
+	snprintf(buf, sizeof(buf), "%s %dx%d %d %d %d %d %d %d %d %d %d"
+		, method
+		, g.width
+		, g.height
+		, g.autoArea
+		, g.rotate
+		, g.exhaustive
+		, g.pad
+		, g.trim
+		, g.fit
+		, g.shrink
+		, g.align
+		, g.gutter
+	);
+	
+	return hash_bytes(HASH_BASIS, buf, strlen(buf));
+}
+
+/* the layout saved in the cache directory for an output file */
+static void layout_filename(char *dst, size_t n, const char *output)
+{
+	cache_filename(dst, n, g.cache, output, "ezlayout");
+}
+
 /* returns if strings were neq (not equal) before making a duplicate */
 static int neqdup(char **dst, const char *src)
 {
@@ -200,6 +269,7 @@ static void cleanup_files(void)
 static void cleanup_images(void)
 {
 	EzSpriteSheetAnimList_free(&animList);
+	scratch_close();
 }
 
 static void cleanup_rectangles(void)
@@ -207,6 +277,68 @@ static void cleanup_rectangles(void)
 	EzSpriteSheetRectList_free(&rectList);
 }
 
+/* images queued for loading by the worker pool */
+struct LoadQueue
+{
+	struct File **file;
+	struct EzSpriteSheetAnim **anim;
+	int writeCache; /* cache each image as soon as it's decoded */
+};
+
+/* decode one queued image (runs on a worker thread) */
+static void load_each(void *udata, int index)
+{
+	struct LoadQueue *q = udata;
+	const char *fn = File_get_path(q->file[index]);
+	
+	q->anim[index] = 0;
+	
+	/* skip decoding images that haven't changed since they were cached */
+	if (g.cache)
+		q->anim[index] = EzSpriteSheetAnim_newFromCache(fn, g.cache);
+	
+	if (!q->anim[index])
+		q->anim[index] = EzSpriteSheetAnim_new(fn);
+	
+	/* on a budget, the pixels are dropped as soon as they've been
+	 * analyzed (and cached), and are reloaded whenever they're used
+	 */
+	if (g.memory)
+	{
+		if (q->writeCache)
+			EzSpriteSheetAnim_writeCache(q->anim[index], g.cache);
+		EzSpriteSheetAnim_evict(q->anim[index]);
+	}
+}
+
+/* decode every queued image across the worker pool, then link
+ * them into the animation list in queue order, so the result
+ * is identical no matter how many jobs were used
+ */
+static void load_images(struct LoadQueue *q
+	, int count
+	, void progress(float unit_interval)
+)
+{
+	int i;
+	
+	/* the cache directory has to exist before workers write to it */
+	q->writeCache = g.memory && g.cache && count;
+	if (q->writeCache && dir_make(g.cache))
+	{
+		complain("failed to create cache directory '%s'", g.cache);
+		q->writeCache = 0;
+	}
+	
+	worker_run(g.jobs, count, load_each, q, progress);
+	
+	for (i = 0; i < count; ++i)
+	{
+		EzSpriteSheetAnimList_push(animList, q->anim[i]);
+		File_set_udata(q->file[i], q->anim[i]);
+	}
+}
+
 void EzSpriteSheet_setPopups(
 	void die(const char *msg)
 	, void complain(const char *msg)
@@ -222,6 +354,176 @@ void EzSpriteSheet_setPopups(
 	success_overload = success;
 }
 
+/* number of threads to use for every multithreaded step
+ * (0 = one thread per processor core)
+ */
+void EzSpriteSheet_setJobs(int jobs)
+{
+	if (jobs < 0)
+		jobs = 0;
+	
+	g.jobs = jobs;
+}
+
+/* directory for caching decoded images across runs (0 = off) */
+void EzSpriteSheet_setCache(const char *cache)
+{
+	neqdup(&g.cache, cache);
+}
+
+/* store decoded pixels in a memory-mapped scratch file (0 = off),
+ * which the OS can page in and out, rather than on the heap
+ */
+void EzSpriteSheet_setScratch(const char *scratch)
+{
+	neqdup(&g.scratch, scratch);
+}
+
+/* limit decoded pixels kept in memory to the given number of megabytes
+ * (0 = keep every image in memory); images whose pixels don't fit are
+ * reloaded from the cache directory, or decoded again, when needed
+ */
+void EzSpriteSheet_setMemory(int megabytes)
+{
+	if (megabytes < 0)
+		megabytes = 0;
+	
+	g.memory = (int64_t)megabytes << 20;
+}
+
+/* search for the smallest page size that fits everything, up to the
+ * width and height given to EzSpriteSheet(), instead of using them as is
+ */
+void EzSpriteSheet_setAreaAuto(int autoArea)
+{
+	g.autoArea = !!autoArea;
+}
+
+/* keep sprites where the previous run placed them, placing only new
+ * or resized ones, unless the ratio of sprite area to page area falls
+ * below 'percent' percent of that of the last full repack (0 = off);
+ * layouts persist across runs in the cache directory, if there is one
+ */
+void EzSpriteSheet_setIncremental(int percent)
+{
+	if (percent < 0)
+		percent = 0;
+	
+	g.incremental = percent;
+}
+
+/* spend 'ms' milliseconds after packing looking for a better order
+ * to pack the sprites in (0 = off)
+ */
+void EzSpriteSheet_setOptimize(int ms)
+{
+	if (ms < 0)
+		ms = 0;
+	
+	g.optimize = ms;
+}
+
+/* seed the optimizer, as "seed" or "seed:trial" to reproduce a trial
+ * it reported without searching; without one (0), a new seed is
+ * picked every run
+ */
+void EzSpriteSheet_setSeed(const char *seed)
+{
+	unsigned long long value = 0;
+	int replay = -1;
+	
+	if (seed
+		&& (sscanf(seed, "%llu:%d", &value, &replay) < 1
+			|| (strchr(seed, ':') && replay < 0)
+		)
+	)
+		die("unknown seed '%s'", seed);
+	
+	g.seed = value;
+	g.seeded = !!seed;
+	g.replay = replay;
+}
+
+/* how pages are chosen while packing: "off" (or 0) fills one page
+ * at a time, "first-fit" and "best-fit" keep every page open for the
+ * first one a sprite fits into, or the fullest one it fits into
+ */
+void EzSpriteSheet_setFit(const char *fit)
+{
+	if (!fit || !strcasecmp(fit, OFFSTR))
+		g.fit = EzSpriteSheetRectFit_None;
+	else if (!strcasecmp(fit, "first-fit"))
+		g.fit = EzSpriteSheetRectFit_First;
+	else if (!strcasecmp(fit, "best-fit"))
+		g.fit = EzSpriteSheetRectFit_Best;
+	else
+		die("unknown fit mode '%s'", fit);
+}
+
+/* which pages to shrink to fit their contents after packing:
+ * "off" (or 0), "last", or "all"
+ */
+void EzSpriteSheet_setShrink(const char *shrink)
+{
+	if (!shrink || !strcasecmp(shrink, OFFSTR))
+		g.shrink = EzSpriteSheetRectShrink_None;
+	else if (!strcasecmp(shrink, "last"))
+		g.shrink = EzSpriteSheetRectShrink_Last;
+	else if (!strcasecmp(shrink, "all"))
+		g.shrink = EzSpriteSheetRectShrink_All;
+	else
+		die("unknown shrink mode '%s'", shrink);
+}
+
+/* with padding, keep sprites 'pad' pixels apart from each other and
+ * from the page's edges, instead of padding every side of each sprite
+ * (which leaves twice that between neighbours)
+ */
+void EzSpriteSheet_setGutter(int gutter)
+{
+	g.gutter = !!gutter;
+}
+
+/* round each sprite's footprint and position on the sheet up to a
+ * multiple of 'align' pixels, e.g. 4 for block-compressed textures
+ * (0 or 1 = off); exported crop rectangles stay exact
+ */
+void EzSpriteSheet_setAlign(int align)
+{
+	if (align <= 1)
+		align = 0;
+	
+	g.align = align;
+}
+
+/* how hard to compress the sheets' PNGs, from 0 (store them without
+ * compression, fastest) to 9 (smallest); < 0 uses the default
+ */
+void EzSpriteSheet_setPngLevel(int level)
+{
+	if (level < 0)
+		level = PNG_LEVEL_DEFAULT;
+	if (level > 9)
+		level = 9;
+	
+	g.pngLevel = level;
+}
+
+/* the format sheets are written in: "png" (or 0), or "bc1" or "bc3"
+ * (also "dxt1" and "dxt5") for block-compressed DDS textures
+ */
+void EzSpriteSheet_setTexture(const char *texture)
+{
+	if (!texture || !strcasecmp(texture, "png"))
+		g.texture = EzSpriteSheetTexture_Png;
+	else if (!strcasecmp(texture, "bc1") || !strcasecmp(texture, "dxt1"))
+		g.texture = EzSpriteSheetTexture_Bc1;
+	else if (!strcasecmp(texture, "bc3") || !strcasecmp(texture, "dxt5"))
+		g.texture = EzSpriteSheetTexture_Bc3;
+	else
+		die("unknown texture format '%s'", texture);
+}
+
 void EzSpriteSheet_cleanup(void)
 {
 	logging_begin();
@@ -233,6 +535,8 @@ void EzSpriteSheet_cleanup(void)
 	free_safe(&g.input);
 	free_safe(&g.output);
 	free_safe(&g.logfile);
+	free_safe(&g.cache);
+	free_safe(&g.scratch);
 	free_safe(&g.page.pix);
 	
 	cleanup_files();
@@ -254,11 +558,10 @@ int EzSpriteSheet_countPages(void)
 	return EzSpriteSheetRectList_getPageCount(rectList);
 }
 
-/* bakes a sprite sheet; instead of having all sprite sheets
- * in memory simultaneously, just get them one by one, as needed
- */
-void *EzSpriteSheet_getPagePixels(
-	int page
+/* bakes a page into a buffer, growing the buffer as needed */
+static void *bake_page(
+	struct PageBuffer *buf
+	, int page
 	, int *w
 	, int *h
 	, int *rects
@@ -266,31 +569,25 @@ void *EzSpriteSheet_getPagePixels(
 	, void progress(float unit_interval)
 )
 {
-	void *p = g.page.pix;
-	
-	if (!rectList
-		|| page < 0
-		|| page >= EzSpriteSheetRectList_getPageCount(rectList)
-	)
-		return 0;
+	void *p = buf->pix;
 	
 	EzSpriteSheetRectList_get_biggest_page(rectList, w, h);
 	
 	/* initial allocation */
 	if (!p)
 	{
-		g.page.maxpix = *w * *h;
+		buf->maxpix = *w * *h;
 		
-		p = malloc_safe(g.page.maxpix * sizeof(uint32_t));
+		p = malloc_safe(buf->maxpix * sizeof(uint32_t));
 	}
 	/* subsequent resizes: fit 1.5x the data needed
 	 * (reduces the frequency of realloc, and reduces fragmentation) */
-	if ((unsigned)*w * *h > g.page.maxpix)
+	if ((unsigned)*w * *h > buf->maxpix)
 	{
-		g.page.maxpix = *w * *h;
-		g.page.maxpix += g.page.maxpix / 2;
+		buf->maxpix = *w * *h;
+		buf->maxpix += buf->maxpix / 2;
 		
-		p = realloc_safe(p, g.page.maxpix * sizeof(uint32_t));
+		p = realloc_safe(p, buf->maxpix * sizeof(uint32_t));
 	}
 	
 	/* page containing sprites */
@@ -301,11 +598,92 @@ void *EzSpriteSheet_getPagePixels(
 		EzSpriteSheetRectList_pageDebugOverlay(rectList, page, p, *w, *h, 0xc0);
 	
 	/* reuse later */
-	g.page.pix = p;
+	buf->pix = p;
 	
 	return p;
 }
 
+/* bakes a sprite sheet; instead of having all sprite sheets
+ * in memory simultaneously, just get them one by one, as needed
+ */
+void *EzSpriteSheet_getPagePixels(
+	int page
+	, int *w
+	, int *h
+	, int *rects
+	, float *occupancy
+	, void progress(float unit_interval)
+)
+{
+	if (!rectList
+		|| page < 0
+		|| page >= EzSpriteSheetRectList_getPageCount(rectList)
+	)
+		return 0;
+	
+	return bake_page(&g.page, page, w, h, rects, occupancy, progress);
+}
+
+/* most memory the pages baked concurrently during export may use */
+#define EXPORT_POOL_BYTES (1u << 30)
+
+/* a page baked and written by a worker thread during export */
+struct ExportPage
+{
+	struct PageBuffer buf;
+	void *pix;
+	int w;
+	int h;
+	int rects;
+	float occupancy;
+};
+
+/* the pages being exported concurrently */
+static struct
+{
+	struct ExportPage *page;
+	int first; /* page number of page[0] */
+	int count; /* pages in this batch */
+	int total; /* pages overall */
+	int jobs; /* threads compressing each page */
+	void (*progress)(float unit_interval);
+} exportBatch;
+
+/* bake a page and write its image (runs on a worker thread) */
+static void export_each(void *udata, int index)
+{
+	struct ExportPage *e = exportBatch.page + index;
+	
+	e->pix = bake_page(&e->buf
+		, exportBatch.first + index
+		, &e->w
+		, &e->h
+		, &e->rects
+		, &e->occupancy
+		, 0
+	);
+	Export_sheet(exportBatch.first + index
+		, e->pix
+		, e->w
+		, e->h
+		, g.pngLevel
+		, exportBatch.jobs
+	);
+	
+	(void)udata;
+}
+
+/* report a batch's progress as progress through every page */
+static void export_progress(float unit_interval)
+{
+	if (unit_interval > 1)
+		return;
+	
+	exportBatch.progress(
+		(exportBatch.first + unit_interval * exportBatch.count) / exportBatch.total
+	);
+}
+
 const char *EzSpriteSheet_export(
 	const char *output
 	, const char *scheme
@@ -317,8 +695,12 @@ const char *EzSpriteSheet_export(
 	const struct Exporter *exporter;
 	struct EzSpriteSheetAnim *anim;
 	int page;
+	int pages;
 	int inputLen;
-	float occupancy;
+	int batch;
+	int threads;
+	int w;
+	int h;
 	
 	if (!prefix)
 		prefix = "";
@@ -339,7 +721,7 @@ const char *EzSpriteSheet_export(
 	logging_begin();
 	
 	/* export process */
-	exporter = Export_begin(scheme, output);
+	exporter = Export_begin(scheme, output, g.texture);
 	exporter->capsule.begin(
 		EzSpriteSheetRectList_getPageCount(rectList)
 		, EzSpriteSheetAnimList_get_count(animList)
@@ -347,27 +729,68 @@ const char *EzSpriteSheet_export(
 		, 0
 	);
 	
-	/* export sheets */
-	for (page = 0
-		; page < EzSpriteSheetRectList_getPageCount(rectList)
-		; ++page
+	/* export sheets: a batch of pages is baked and written across
+	 * threads, one buffer per page, then handed to the exporter in
+	 * order; batches are as big as there are threads, but no bigger
+	 * than EXPORT_POOL_BYTES of buffers allows
+	 */
+	pages = EzSpriteSheetRectList_getPageCount(rectList);
+	EzSpriteSheetRectList_get_biggest_page(rectList, &w, &h);
+	threads = (g.jobs > 0) ? g.jobs : worker_count();
+	batch = threads;
+	while (batch > 1 && (double)batch * w * h * sizeof(uint32_t) > EXPORT_POOL_BYTES)
+		--batch;
+	if (batch > pages)
+		batch = pages;
+	if (batch < 1)
+		batch = 1;
+	
+	exportBatch.page = calloc_safe(batch, sizeof(*exportBatch.page));
+	exportBatch.total = pages;
+	exportBatch.progress = progress;
+	
+	for (exportBatch.first = 0
+		; exportBatch.first < pages
+		; exportBatch.first += batch
 	)
 	{
-		void *p;
-		int w;
-		int h;
-		int isFirst = page == 0;
-		int isLast = (page + 1) == EzSpriteSheetRectList_getPageCount(rectList);
-		int rects;
+		int i;
+		
+		exportBatch.count = pages - exportBatch.first;
+		if (exportBatch.count > batch)
+			exportBatch.count = batch;
 		
-		p = EzSpriteSheet_getPagePixels(page, &w, &h, &rects, &occupancy, progress);
+		/* threads left over compress each page in bands */
+		exportBatch.jobs = threads / exportBatch.count;
+		if (exportBatch.jobs < 1)
+			exportBatch.jobs = 1;
 		
-		assert(p);
+		worker_run(g.jobs
+			, exportBatch.count
+			, export_each
+			, 0
+			, (progress) ? export_progress : 0
+		);
 		
-		exporter->sheet.begin(page, p, w, h, isFirst, isLast);
-		exporter->sheet.end(page, p, w, h, isFirst, isLast);
+		for (i = 0; i < exportBatch.count; ++i)
+		{
+			struct ExportPage *e = exportBatch.page + i;
+			int isFirst;
+			int isLast;
+			
+			page = exportBatch.first + i;
+			isFirst = page == 0;
+			isLast = (page + 1) == pages;
+			
+			exporter->sheet.begin(page, e->pix, e->w, e->h, isFirst, isLast);
+			exporter->sheet.end(page, e->pix, e->w, e->h, isFirst, isLast);
+		}
 	}
 	
+	for (page = 0; page < batch; ++page)
+		free_safe(&exportBatch.page[page].buf.pix);
+	free_safe(&exportBatch.page);
+	
 	/* export info about each animation */
 	for (anim = EzSpriteSheetAnimList_head(animList)
 		; anim
@@ -458,6 +881,13 @@ const char *EzSpriteSheet_export(
 				page = EzSpriteSheetRect_get_page(rect);
 				rot = EzSpriteSheetRect_get_rotated(rect);
 				EzSpriteSheetRect_get_crop(rect, &x, &y, &w, &h);
+				
+				/* report the same padded rectangle either way */
+				if (g.gutter)
+				{
+					w += g.pad;
+					h += g.pad;
+				}
 			}
 			else
 				rot = page = ox = oy = x = y = w = h = 0;
@@ -590,6 +1020,14 @@ const char *EzSpriteSheet(
 		|| g.rotate != rotate /* rotation logic changes pack result */
 		|| g.exhaustive != exhaustive /* so does exhaustive logic */
 		|| g.doubles != doubles /* omitting duplicates saves space */
+		|| g.autoAreaPacked != g.autoArea /* page dimensions may change */
+		|| g.fitPacked != g.fit /* so does the choice of page */
+		|| g.shrinkPacked != g.shrink /* shrinking moves rects around */
+		|| g.alignPacked != g.align /* aligned rects are larger */
+		|| g.gutterPacked != g.gutter /* shared gutters are smaller */
+		|| g.optimizePacked != g.optimize /* so does optimizing */
+		|| g.replayPacked != g.replay
+		|| (g.seeded && g.seedPacked != g.seed)
 	)
 		doRectangles = 1;
 	
@@ -619,24 +1057,53 @@ const char *EzSpriteSheet(
 	g.height = height;
 	g.color = color;
 	g.negate = negate;
+	g.autoAreaPacked = g.autoArea;
+	g.fitPacked = g.fit;
+	g.shrinkPacked = g.shrink;
+	g.alignPacked = g.align;
+	g.gutterPacked = g.gutter;
+	g.optimizePacked = g.optimize;
+	g.replayPacked = g.replay;
 	
 	/* echo retrieved arguments back to user */
 	info("The following selections were made:");
 	info("  Input       '%s'", input);
 	info("  Output      '%s'", output);
-	info("  Area        '%dx%d'", width, height);
+	info("  Area        '%s%dx%d'", (g.autoArea) ? "auto:" : "", width, height);
 	info("  Scheme      '%s'", scheme);
 	info("  Method      '%s'", method);
 	info("  Formats     '%s'", formats);
 	info("  RegEx       '%s' (%s)", (expr) ? expr : OFFSTR, regmatch);
 	info("  Log         '%s'", (logfile) ? logfile : OFFSTR);
+	info("  Cache       '%s'", (g.cache) ? g.cache : OFFSTR);
+	info("  Memory      '%s' (%d MB)", BOOL_ON_OFF(g.memory), (int)(g.memory >> 20));
+	info("  Scratch     '%s'", (g.scratch) ? g.scratch : OFFSTR);
 	info("  Doubles     '%s'", BOOL_ON_OFF(doubles));
 	info("  Visual      '%s'", BOOL_ON_OFF(visual));
 	info("  Exhaustive  '%s'", BOOL_ON_OFF(exhaustive));
 	info("  Rotate      '%s'", BOOL_ON_OFF(rotate));
 	info("  Trim        '%s'", BOOL_ON_OFF(trim));
-	info("  Pad         '%s' (%d)", BOOL_ON_OFF(pad), pad);
+	info("  Pad         '%s' (%d%s)", BOOL_ON_OFF(pad), pad, (g.gutter) ? ", shared" : "");
+	info("  Incremental '%s' (%d%%)", BOOL_ON_OFF(g.incremental), g.incremental);
+	info("  Fit         '%s'"
+		, (g.fit == EzSpriteSheetRectFit_Best) ? "best-fit"
+		: (g.fit == EzSpriteSheetRectFit_First) ? "first-fit"
+		: OFFSTR
+	);
+	info("  Optimize    '%s' (%d ms)", BOOL_ON_OFF(g.optimize), g.optimize);
+	info("  Align       '%s' (%d)", BOOL_ON_OFF(g.align), g.align);
+	info("  Shrink      '%s'"
+		, (g.shrink == EzSpriteSheetRectShrink_All) ? "all"
+		: (g.shrink == EzSpriteSheetRectShrink_Last) ? "last"
+		: OFFSTR
+	);
 	info("  Color       '%s' (%06x)", BOOL_ON_OFF(color), color);
+	info("  PNG Level   '%d'%s", g.pngLevel, (g.pngLevel) ? "" : " (store only)");
+	info("  Texture     '%s'"
+		, (g.texture == EzSpriteSheetTexture_Bc1) ? "bc1"
+		: (g.texture == EzSpriteSheetTexture_Bc3) ? "bc3"
+		: "png"
+	);
 	
 	/* file tree refresh */
 	if (doFileTree)
@@ -653,17 +1120,26 @@ const char *EzSpriteSheet(
 		
 		/* brand new animation list */
 		animList = EzSpriteSheetAnimList_new();
+		if (g.scratch)
+			scratch_open(g.scratch);
 	}
 	
+	/* how many pixels stay in memory, and where evicted ones come from */
+	EzSpriteSheetAnimList_setBudget(animList, g.memory, g.cache);
+	
 	/* image list refresh */
 	if (doImages || doImageAll)
 	{
 		struct File *file;
+		struct LoadQueue queue;
 		int loaded = 0;
 		int count = FileList_get_count(fileList);
 		if (!count)
 			goto emtyFileList;
 		
+		queue.file = malloc_safe(count * sizeof(*queue.file));
+		queue.anim = malloc_safe(count * sizeof(*queue.anim));
+		
 		/* optimization: only clean up images with undesirable extensions
 		 *               or those filtered by regex (mis)matches
 		 */
@@ -720,19 +1196,17 @@ const char *EzSpriteSheet(
 				if (File_get_udata(file))
 					continue;
 				
-				/* load animation and associate with file */
-				++loaded;
+				/* queue animation for loading */
 				info("Load image file '%s'", fn);
-				anim = EzSpriteSheetAnim_new(fn);
-				EzSpriteSheetAnimList_push(animList, anim);
-				File_set_udata(file, anim);
+				queue.file[loaded++] = file;
 			}
-			
-			/* report progress */
-			if (load_progress)
-				load_progress(((float)loaded) / count);
 		}
 		
+		/* load animations and associate each with its file */
+		load_images(&queue, loaded, load_progress);
+		free_safe(&queue.file);
+		free_safe(&queue.anim);
+		
 		if (!loaded)
 		{
 		emtyFileList:
@@ -763,6 +1237,10 @@ const char *EzSpriteSheet(
 		 */
 		EzSpriteSheetAnimList_each_findCrop(animList);
 		
+		/* newly decoded images are cached for next time */
+		if (g.cache)
+			EzSpriteSheetAnimList_each_writeCache(animList, g.cache);
+		
 		if (doImageAll || formatsChanged)
 		{
 			EzSpriteSheetAnimList_each_clearDuplicates(animList);
@@ -791,15 +1269,36 @@ const char *EzSpriteSheet(
 	if (doRectangles)
 	{
 		enum EzSpriteSheetRectPack packer = 0;
+		struct EzSpriteSheetRectList *prev = 0;
+		uint64_t signature = layout_signature(method);
+		char layoutfn[4096];
 		int badsize = 0;
+		int margin = (g.gutter) ? g.pad : 0; /* page area sprites can't use */
 		*totalDuplicates = 0;
 		*totalSprites = 0;
 		
+		if (g.cache)
+			layout_filename(layoutfn, sizeof(layoutfn), output);
+		
+		/* the previous layout, if packed the same way, seeds this one */
+		if (g.incremental)
+		{
+			if (rectList && g.layoutSignature == signature)
+			{
+				prev = rectList;
+				rectList = 0;
+			}
+			else if (g.cache)
+				prev = EzSpriteSheetRectList_readLayout(layoutfn, signature);
+		}
+		
 		/* clean up all rectangles; constructing new ones isn't costly */
 		cleanup_rectangles();
 		
 		/* allocate and propagate rectangle list */
 		rectList = EzSpriteSheetRectList_new();
+		EzSpriteSheetRectList_setAlign(rectList, g.align);
+		EzSpriteSheetRectList_setMargin(rectList, margin);
 		
 		for (anim = EzSpriteSheetAnimList_head(animList)
 			; anim
@@ -807,10 +1306,12 @@ const char *EzSpriteSheet(
 		)
 		{
 			struct EzSpriteSheetAnimFrame *frame;
+			int frameIndex = 0;
 			
 			while ((frame = EzSpriteSheetAnim_each_frame(anim)))
 			{
 				struct EzSpriteSheetRect *rect = 0;
+				int index = frameIndex++;
 				int x;
 				int y;
 				int w;
@@ -836,12 +1337,16 @@ const char *EzSpriteSheet(
 				
 				get_crop(frame, &x, &y, &w, &h);
 				
-				w += g.pad * 2;
-				h += g.pad * 2;
+				/* a shared gutter is only on the right and bottom,
+				 * the page's margin takes care of the other edges
+				 */
+				w += (g.gutter) ? g.pad : g.pad * 2;
+				h += (g.gutter) ? g.pad : g.pad * 2;
 				
-	
 				/* preprocessing step: complain if page size too small */
-				if (w > width || h > height)
+				if (EzSpriteSheetRectList_alignUp(rectList, w) + margin > width
+					|| EzSpriteSheetRectList_alignUp(rectList, h) + margin > height
+				)
 				{
 					badsize = 1;
 					complain(
@@ -859,6 +1364,9 @@ const char *EzSpriteSheet(
 				
 				//fprintf(stderr, "%s frame %d\n", fn, k - 1);
 				rect = EzSpriteSheetRectList_push(rectList, frame, w, h);
+				EzSpriteSheetRect_set_key(rect
+					, frame_key(EzSpriteSheetAnim_get_name(anim), index)
+				);
 				EzSpriteSheetAnimFrame_set_udata(frame, rect);
 				*totalSprites += 1;
 			}
@@ -873,17 +1381,96 @@ const char *EzSpriteSheet(
 		}
 		else
 		{
+			int best = !strcasecmp(method, "best");
+		
 		#define METHOD(A, B) \
 			if (!strcasecmp(method, A)) \
 				packer = EzSpriteSheetRectPack_ ## B
-			METHOD("maxrects", MaxRects);
+			/* best searches sizes using the default method */
+			if (best)
+				packer = EzSpriteSheetRectPack_MaxRects;
+			else METHOD("maxrects", MaxRects);
 			else METHOD("guillotine", Guillotine);
+			else METHOD("skyline", Skyline);
+			else METHOD("skyline-wastemap", SkylineWasteMap);
 			else die("unknown method '%s'", method);
 		#undef METHOD
-			
+		
 			EzSpriteSheetRectList_sort(rectList, EzSpriteSheetRectSort_Area);
-			EzSpriteSheetRectList_pack(rectList, packer, width, height, rotate, exhaustive, pack_progress);
+			EzSpriteSheetRectList_setFit(rectList, g.fit);
+			
+			/* sprites that haven't changed stay where they were,
+			 * unless that fails, in which case everything is repacked
+			 */
+			if (!prev || EzSpriteSheetRectList_packIncremental(rectList
+					, prev
+					, g.incremental / 100.0f
+					, pack_progress
+				)
+			)
+			{
+				/* width and height are the largest page size allowed */
+				if (g.autoArea)
+				{
+					EzSpriteSheetRectList_findArea(rectList
+						, packer
+						, width
+						, height
+						, rotate
+						, exhaustive
+						, g.jobs /* 0 = one thread per core */
+						, &width
+						, &height
+					);
+					info("Selected area '%dx%d'", width, height);
+				}
+				
+				/* try every method and keep the best one */
+				if (best)
+					EzSpriteSheetRectList_packBest(rectList
+						, width
+						, height
+						, rotate
+						, exhaustive
+						, g.jobs /* 0 = one thread per core */
+						, pack_progress
+					);
+				else
+					EzSpriteSheetRectList_pack(rectList, packer, width, height, rotate, exhaustive, pack_progress);
+				
+				/* look for a better order to pack them in */
+				if (g.optimize || (g.seeded && g.replay >= 0))
+				{
+					/* short enough to type back in */
+					if (!g.seeded)
+					{
+						int64_t now = time(0) ^ worker_clock();
+						
+						g.seed = hash_bytes(HASH_BASIS, &now, sizeof(now)) & 0xffffffff;
+					}
+					g.seedPacked = g.seed;
+					
+					info("Optimizing with seed %llu", (unsigned long long)g.seed);
+					EzSpriteSheetRectList_optimize(rectList
+						, g.optimize
+						, g.seed
+						, (g.seeded) ? g.replay : -1
+						, g.jobs /* 0 = one thread per core */
+						, pack_progress
+					);
+				}
+			}
+			
+			/* trim wasted space off the page(s) */
+			EzSpriteSheetRectList_shrink(rectList, g.shrink);
+			
+			/* remember the layout for next time */
+			g.layoutSignature = signature;
+			if (g.incremental && g.cache)
+				EzSpriteSheetRectList_writeLayout(rectList, layoutfn, signature);
 		}
+		
+		EzSpriteSheetRectList_free(&prev);
 	}
 	
 	//info("wow");
@@ -13,8 +13,8 @@ CONFIG += static
 DEFINES += "_XOPEN_SOURCE=500"
 DEFINES += _DEFAULT_SOURCE
 
-# link giflib and libwebp
-QMAKE_LFLAGS += " -lgif -lm -lwebp "
+# link giflib, libwebp, and pthreads
+QMAKE_LFLAGS += " -lgif -lm -lwebp -lpthread "
 DEFINES += WEBP_HAVE_GIF
 
 #win32 { QMAKE_LFLAGS += " -lpcre2-posix -lpcre2-8 -municode " }
@@ -27,13 +27,18 @@ SOURCES += \
 
 # ezspritesheet core
 SOURCES += \
+    ../../analyze.c \
     ../../animation.c \
     ../../common.c \
     ../../exporter.c \
     ../../ezspritesheet.c \
     ../../file.c \
     ../../nftw_utf8.c \
-    ../../rectangle.c
+    ../../png.c \
+    ../../rectangle.c \
+    ../../scratch.c \
+    ../../texture.c \
+    ../../worker.c
 
 # ezspritesheet exporters
 SOURCES += \
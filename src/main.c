@@ -68,11 +68,21 @@ static int usage(FILE *stream, int argc)
 	P("                      c99");
 	P("  -m, --method    select packing method");
 	P("                    supported packing methods:");
-	P("                      guillotine  (fastest, worst)");
+	P("                      skyline     (fastest, worst)");
+	P("                      skyline-wastemap");
+	P("                                  (skyline that reuses space");
+	P("                                   left behind under the skyline)");
+	P("                      guillotine  (fast)");
 	//P("                      wowrects");
-	P("                      maxrects    (slowest, best)");
+	P("                      maxrects    (slower, better)");
+	P("                      best        (tries every method and heuristic");
+	P("                                   on every core, keeps the best)");
 	P("  -a, --area      specify area of generated sprite sheet");
 	P("                  width by height, e.g. --area 1024x1024");
+	P("                  or 'auto' to use the smallest area that fits every");
+	P("                  sprite on one page, optionally with a maximum,");
+	P("                  e.g. --area auto:2048 or --area auto:2048x1024");
+	P("                  (the maximum defaults to 4096x4096)");
 	P("--Optional Arguments----------------------------------------------------");
 	P("  -h, --help      prints this usage information");
 	P("  -e, --exhaust   exhaustive packing (doesn't consider a sprite");
@@ -83,6 +93,40 @@ static int usage(FILE *stream, int argc)
 	P("  -d, --doubles   detect and omit duplicate sprites (doubles)");
 	P("  -b, --border    add padding around each packed sprite");
 	P("                  e.g. --border 8 (for 8 pixels)");
+	P("  -gu, --gutter   with --border, keep sprites that many pixels apart");
+	P("                  and from the sheet's edges, rather than padding");
+	P("                  each sprite (which doubles the gap between them)");
+	P("  -u, --incremental  keep sprites where the previous run put them,");
+	P("                  placing only new or resized ones, unless sprite");
+	P("                  sheet fill drops below the given percentage of a");
+	P("                  full repack's, e.g. --incremental 90 (layouts are");
+	P("                  saved in the --cache directory between runs)");
+	P("  -y, --fit       keep every sprite sheet open while packing,");
+	P("                  instead of finishing one before starting the");
+	P("                  next (often saves whole sheets)");
+	P("                  e.g. --fit first-fit (first sheet a sprite fits on)");
+	P("                       --fit best-fit  (fullest sheet it fits on)");
+	P("  -om, --optimize-ms  after packing, spend up to the given number of");
+	P("                  milliseconds on every core trying other orders to");
+	P("                  pack sprites in, keeping the best layout found");
+	P("                  e.g. --optimize-ms 2000");
+	P("  -se, --seed     seed the optimizer so results can be reproduced;");
+	P("                  e.g. --seed 1234 (searches like any other run)");
+	P("                       --seed 1234:56 (rebuilds the reported trial)");
+	P("  -al, --align    place sprites at multiples of the given number of");
+	P("                  pixels, e.g. --align 4 so sprites never share a");
+	P("                  block of a --texture (crops stay exact)");
+	P("  -g, --shrink    shrink pages to the smallest size their sprites");
+	P("                  can be repacked into, to save memory and bytes");
+	P("                  e.g. --shrink last (last page only)");
+	P("                       --shrink all  (every page)");
+	P("  -pl, --png-level  how hard to compress sheets, from 0 (store");
+	P("                  only, fastest) to 9 (smallest); default is 6");
+	P("                  e.g. --png-level 9");
+	P("  -tx, --texture  write sheets as block-compressed DDS textures");
+	P("                  instead of PNGs, ready for uploading to a GPU");
+	P("                  e.g. --texture bc1 (DXT1, 1-bit alpha)");
+	P("                       --texture bc3 (DXT5, smooth alpha)");
 	P("  -c, --color     treat pixels matching hex color as animation pivots");
 	P("                  e.g. --color 00ff00");
 	P("                  (complains if multiple possible matches are found)");
@@ -98,6 +142,21 @@ static int usage(FILE *stream, int argc)
 	P("                  the provided --regex pattern");
 	P("  -v, --visual    visualize sprite boundaries (debug feature)");
 	P("                  (makes each sprite's background a random color)");
+	P("  -j, --jobs      number of threads to use for decoding images, for");
+	P("                  '--method best', '--area auto' and '--optimize-ms',");
+	P("                  and for baking, compressing and writing sheets,");
+	P("                  e.g. --jobs 8 (0, the default, = one per core)");
+	P("  -k, --cache     cache decoded images in the specified directory;");
+	P("                  unchanged images are loaded from the cache on");
+	P("                  subsequent runs instead of being decoded again");
+	P("  -mb, --memory   keep at most the given number of megabytes of");
+	P("                  decoded images in memory, reloading the rest");
+	P("                  when sheets are written (from the --cache");
+	P("                  directory if given), e.g. --memory 512");
+	P("  -sc, --scratch  keep decoded images in the specified file, mapped");
+	P("                  into memory, so the OS can page them in and out");
+	P("                  instead of running out of memory (the file is");
+	P("                  deleted afterwards), e.g. --scratch /tmp/ez.bin");
 	P("  -l, --log       specify log file (stderr is used otherwise)");
 	P("  -w, --warnings  log only errors and warnings");
 	P("  -q, --quiet     don't log anything");
@@ -170,6 +229,12 @@ int main(int argc, char *argv[])
 	const char *output = 0;
 	const char *logfile = 0;
 	const char *prefix = 0;
+	const char *cache = 0;
+	const char *scratch = 0;
+	const char *shrink = 0;
+	const char *fit = 0;
+	const char *seed = 0;
+	const char *texture = 0;
 	int warnings = 0;
 	int exhaustive = 0;
 	int rotate = 0;
@@ -181,6 +246,14 @@ int main(int argc, char *argv[])
 	int height = 0;
 	int negate = 0;
 	int longnames = 0;
+	int jobs = 0;
+	int memory = 0;
+	int autoArea = 0;
+	int incremental = 0;
+	int optimize = 0;
+	int pngLevel = -1; /* default */
+	int align = 0;
+	int gutter = 0;
 	uint32_t color = 0;
 	/* misc */
 	const char *errstr = 0;
@@ -215,13 +288,18 @@ int main(int argc, char *argv[])
 	if (argc == 1)
 		return usage(stderr, argc);
 	
-	/* complain about duplicate arguments/parameters
-	 * (in case user accidentally provides two packing methods, etc)
+	/* complain about duplicate arguments
+	 * (in case user accidentally provides two packing methods, etc);
+	 * only flags are compared, as parameters such as numbers can
+	 * legitimately repeat, e.g. --border 4 --align 4
 	 */
 	for (i = 0; i < argc; ++i)
 	{
 		int k;
 		
+		if (*argv[i] != '-')
+			continue;
+		
 		for (k = 0; k < argc; ++k)
 		{
 			/* do not test against self */
@@ -229,7 +307,7 @@ int main(int argc, char *argv[])
 				continue;
 			
 			if (!strcasecmp(argv[i], argv[k]))
-				die("duplicate argument or parameter '%s'", argv[i]);
+				die("duplicate argument '%s'", argv[i]);
 		}
 	}
 	
@@ -254,6 +332,7 @@ int main(int argc, char *argv[])
 		else if (ARGMATCH("e", "exhaust")) { exhaustive = 1; continue; }
 		else if (ARGMATCH("n", "negate")) { negate = 1; continue; }
 		else if (ARGMATCH("z", "long")) { longnames = 1; continue; }
+		else if (ARGMATCH("gu", "gutter")) { gutter = 1; continue; }
 		
 	/* arguments requiring additional parameters */
 		
@@ -268,6 +347,12 @@ int main(int argc, char *argv[])
 		else if (ARGMATCH("f", "formats")) formats = param;
 		else if (ARGMATCH("x", "regex")) expr = param;
 		else if (ARGMATCH("p", "prefix")) prefix = param;
+		else if (ARGMATCH("k", "cache")) cache = param;
+		else if (ARGMATCH("sc", "scratch")) scratch = param;
+		else if (ARGMATCH("g", "shrink")) shrink = param;
+		else if (ARGMATCH("y", "fit")) fit = param;
+		else if (ARGMATCH("se", "seed")) seed = param;
+		else if (ARGMATCH("tx", "texture")) texture = param;
 		else if (ARGMATCH("b", "border")) {
 			if (sscanf(param, "%d", &pad) != 1
 				|| pad <= 0
@@ -278,6 +363,57 @@ int main(int argc, char *argv[])
 				|| color == 0
 			) die("argument '%s' expects hexadecimal value != %06x", this, 0);
 		}
+		else if (ARGMATCH("j", "jobs")) {
+			if (sscanf(param, "%d", &jobs) != 1
+				|| jobs < 0
+			) die("argument '%s' expects decimal integer >= 0", this);
+			if (!jobs)
+				jobs = worker_count();
+		}
+		else if (ARGMATCH("mb", "memory")) {
+			if (sscanf(param, "%d", &memory) != 1
+				|| memory <= 0
+			) die("argument '%s' expects decimal integer > 0", this);
+		}
+		else if (ARGMATCH("u", "incremental")) {
+			if (sscanf(param, "%d", &incremental) != 1
+				|| incremental <= 0
+				|| incremental > 100
+			) die("argument '%s' expects percentage between 1 and 100", this);
+		}
+		else if (ARGMATCH("al", "align")) {
+			if (sscanf(param, "%d", &align) != 1
+				|| align <= 0
+			) die("argument '%s' expects decimal integer > 0", this);
+		}
+		else if (ARGMATCH("pl", "png-level")) {
+			if (sscanf(param, "%d", &pngLevel) != 1
+				|| pngLevel < 0
+				|| pngLevel > 9
+			) die("argument '%s' expects decimal integer between 0 and 9", this);
+		}
+		else if (ARGMATCH("om", "optimize-ms")) {
+			if (sscanf(param, "%d", &optimize) != 1
+				|| optimize <= 0
+			) die("argument '%s' expects decimal integer > 0", this);
+		}
+		else if (ARGMATCH("a", "area") && !strncasecmp(param, "auto", 4)) {
+			autoArea = 1;
+			width = height = 4096;
+			if (param[4] == ':')
+			{
+				switch (sscanf(param + 5, "%dx%d", &width, &height))
+				{
+					case 1: height = width; break;
+					case 2: break;
+					default: width = 0; break;
+				}
+			}
+			else if (param[4])
+				width = 0;
+			if (width <= 0 || height <= 0)
+				die("argument '%s' expects auto or auto:max e.g. auto:2048", this);
+		}
 		else if (ARGMATCH("a", "area")) {
 			if (sscanf(param, "%dx%d", &width, &height) != 2
 				|| width <= 0
@@ -307,6 +443,21 @@ int main(int argc, char *argv[])
 #undef REQUIRE
 	}
 	
+	EzSpriteSheet_setJobs(jobs);
+	EzSpriteSheet_setCache(cache);
+	EzSpriteSheet_setMemory(memory);
+	EzSpriteSheet_setScratch(scratch);
+	EzSpriteSheet_setAreaAuto(autoArea);
+	EzSpriteSheet_setIncremental(incremental);
+	EzSpriteSheet_setFit(fit);
+	EzSpriteSheet_setOptimize(optimize);
+	EzSpriteSheet_setSeed(seed);
+	EzSpriteSheet_setShrink(shrink);
+	EzSpriteSheet_setGutter(gutter);
+	EzSpriteSheet_setAlign(align);
+	EzSpriteSheet_setPngLevel(pngLevel);
+	EzSpriteSheet_setTexture(texture);
+	
 	/* throw the retrieved arguments at the main driver */
 	EzSpriteSheet(
 		formats
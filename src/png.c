@@ -0,0 +1,629 @@
+/*
+ * png.c <z64.me>
+ * 
+ * EzSpriteSheet's PNG writer lives here
+ * 
+ * a sheet is cut into bands of rows, and each band is filtered and
+ * deflated by a thread of its own, with the 32 KiB of filtered bytes
+ * preceding it as a dictionary so little is lost at the cuts; every
+ * band but the last ends on a byte boundary (an empty stored block
+ * follows its compressed block, as in pigz), so the bands can be
+ * written back to back as one IDAT chunk apiece and still make up
+ * a single valid zlib stream; the checksums are computed per band
+ * and combined at the end
+ * 
+ * level 0 stores the pixels without compressing them at all, while
+ * levels 1 - 9 search longer and longer hash chains for matches,
+ * level 6 searching as far as stb_image_write does by default
+ * 
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PNG_BAND_BYTES (128 * 1024) /* filtered bytes per band, at least */
+#define PNG_WINDOW     32768 /* farthest back a match may be */
+#define PNG_HASH       16384 /* buckets in the match finder's hash table */
+#define PNG_ADLER      65521 /* largest prime below 65536 */
+#define PNG_ADLER_RUN  5552 /* bytes adler32 can sum before reducing */
+
+/* bytes being written, a few bits at a time */
+struct PngStream
+{
+	uint8_t *data;
+	size_t count;
+	size_t alloc;
+	uint32_t bitbuf;
+	int bitcount;
+};
+
+/* rows filtered and deflated by one thread */
+struct PngBand
+{
+	struct PngStream out;
+	size_t start; /* offset of band's first filtered byte */
+	size_t end; /* offset following band's last filtered byte */
+	uint32_t adler; /* of the band's filtered bytes */
+	uint32_t crc; /* of the band's IDAT chunk */
+};
+
+/* the image being written */
+struct Png
+{
+	const uint8_t *rgba;
+	uint8_t *filtered; /* each row, prefixed by the filter it uses */
+	uint8_t *zero; /* a row of zeroes, preceding the first row */
+	struct PngBand *band;
+	uint32_t crcTable[256];
+	int bands;
+	int rows; /* rows per band */
+	int stride; /* bytes per row of pixels */
+	int h;
+	int chain; /* longest hash chain to search (0 = store only) */
+};
+
+static void PngStream_reserve(struct PngStream *s, size_t bytes)
+{
+	if (s->count + bytes <= s->alloc)
+		return;
+	
+	if (!s->alloc)
+		s->alloc = 4096;
+	while (s->alloc < s->count + bytes)
+		s->alloc *= 2;
+	
+	s->data = realloc_safe(s->data, s->alloc);
+}
+
+static void PngStream_byte(struct PngStream *s, uint8_t b)
+{
+	PngStream_reserve(s, 1);
+	s->data[s->count++] = b;
+}
+
+static void PngStream_bytes(struct PngStream *s, const void *src, size_t bytes)
+{
+	PngStream_reserve(s, bytes);
+	memcpy(s->data + s->count, src, bytes);
+	s->count += bytes;
+}
+
+static void PngStream_bits(struct PngStream *s, uint32_t bits, int count)
+{
+	s->bitbuf |= bits << s->bitcount;
+	s->bitcount += count;
+	
+	while (s->bitcount >= 8)
+	{
+		PngStream_byte(s, s->bitbuf);
+		s->bitbuf >>= 8;
+		s->bitcount -= 8;
+	}
+}
+
+/* pad with zero bits to the next byte boundary */
+static void PngStream_align(struct PngStream *s)
+{
+	if (s->bitcount)
+		PngStream_bits(s, 0, 8 - s->bitcount);
+}
+
+/* Huffman codes are packed starting from their most significant bit */
+static void PngStream_code(struct PngStream *s, uint32_t code, int count)
+{
+	uint32_t reversed = 0;
+	int i;
+	
+	for (i = 0; i < count; ++i, code >>= 1)
+		reversed = (reversed << 1) | (code & 1);
+	
+	PngStream_bits(s, reversed, count);
+}
+
+/* a literal/length symbol, from deflate's fixed Huffman table */
+static void PngStream_symbol(struct PngStream *s, int symbol)
+{
+	if (symbol <= 143)
+		PngStream_code(s, 0x30 + symbol, 8);
+	else if (symbol <= 255)
+		PngStream_code(s, 0x190 + symbol - 144, 9);
+	else if (symbol <= 279)
+		PngStream_code(s, symbol - 256, 7);
+	else
+		PngStream_code(s, 0xc0 + symbol - 280, 8);
+}
+
+/* bytes as stored blocks, starting on a byte boundary; storing zero
+ * bytes still writes an (empty) block
+ */
+static void PngStream_stored(struct PngStream *s, const uint8_t *src, size_t bytes, int final)
+{
+	do
+	{
+		unsigned len = (bytes > 65535) ? 65535 : bytes;
+		
+		PngStream_byte(s, final && len == bytes); /* BFINAL, BTYPE = 00 */
+		PngStream_byte(s, len);
+		PngStream_byte(s, len >> 8);
+		PngStream_byte(s, ~len);
+		PngStream_byte(s, ~len >> 8);
+		PngStream_bytes(s, src, len);
+		
+		src += len;
+		bytes -= len;
+	} while (bytes);
+}
+
+static uint32_t png_crc(const struct Png *png, uint32_t crc, const void *src, size_t bytes)
+{
+	const uint8_t *b = src;
+	
+	while (bytes--)
+		crc = png->crcTable[(crc ^ *b++) & 0xff] ^ (crc >> 8);
+	
+	return crc;
+}
+
+static uint32_t png_adler(const uint8_t *src, size_t bytes)
+{
+	uint32_t a = 1;
+	uint32_t b = 0;
+	
+	while (bytes)
+	{
+		size_t run = (bytes > PNG_ADLER_RUN) ? PNG_ADLER_RUN : bytes;
+		
+		bytes -= run;
+		while (run--)
+		{
+			a += *src++;
+			b += a;
+		}
+		a %= PNG_ADLER;
+		b %= PNG_ADLER;
+	}
+	
+	return (b << 16) | a;
+}
+
+/* the adler32 of two runs of bytes back to back, given the adler32
+ * of each run and the length of the second (as zlib does it)
+ */
+static uint32_t png_adler_combine(uint32_t first, uint32_t second, size_t secondBytes)
+{
+	uint32_t rem = secondBytes % PNG_ADLER;
+	uint32_t a = first & 0xffff;
+	uint32_t b = (rem * a) % PNG_ADLER;
+	
+	a += (second & 0xffff) + PNG_ADLER - 1;
+	b += (first >> 16) + (second >> 16) + PNG_ADLER - rem;
+	
+	if (a >= PNG_ADLER)
+		a -= PNG_ADLER;
+	if (a >= PNG_ADLER)
+		a -= PNG_ADLER;
+	if (b >= PNG_ADLER * 2)
+		b -= PNG_ADLER * 2;
+	if (b >= PNG_ADLER)
+		b -= PNG_ADLER;
+	
+	return (b << 16) | a;
+}
+
+static void png_chunk(FILE *fp, const char *type, const void *data, uint32_t bytes, uint32_t crc)
+{
+	uint8_t len[4] = { bytes >> 24, bytes >> 16, bytes >> 8, bytes };
+	uint8_t sum[4] = { crc >> 24, crc >> 16, crc >> 8, crc };
+	
+	fwrite(len, 1, 4, fp);
+	fwrite(type, 1, 4, fp);
+	if (bytes)
+		fwrite(data, 1, bytes, fp);
+	fwrite(sum, 1, 4, fp);
+}
+
+/* a chunk whose CRC hasn't been computed yet */
+static void png_chunk_small(FILE *fp, const struct Png *png, const char *type, const void *data, uint32_t bytes)
+{
+	uint32_t crc = png_crc(png, ~0u, type, 4);
+	
+	crc = png_crc(png, crc, data, bytes) ^ ~0u;
+	png_chunk(fp, type, data, bytes, crc);
+}
+
+static uint8_t png_paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	
+	if (pa <= pb && pa <= pc)
+		return a;
+	if (pb <= pc)
+		return b;
+	return c;
+}
+
+/* apply a filter to a row of pixels, given the row above it */
+static void png_filter_row(uint8_t *dst, int type, const uint8_t *row, const uint8_t *above, int bytes)
+{
+	int i;
+	
+	switch (type)
+	{
+		case 0:
+			memcpy(dst, row, bytes);
+			break;
+		
+		case 1:
+			for (i = 0; i < 4; ++i)
+				dst[i] = row[i];
+			for (; i < bytes; ++i)
+				dst[i] = row[i] - row[i - 4];
+			break;
+		
+		case 2:
+			for (i = 0; i < bytes; ++i)
+				dst[i] = row[i] - above[i];
+			break;
+		
+		case 3:
+			for (i = 0; i < 4; ++i)
+				dst[i] = row[i] - (above[i] >> 1);
+			for (; i < bytes; ++i)
+				dst[i] = row[i] - ((row[i - 4] + above[i]) >> 1);
+			break;
+		
+		case 4:
+			for (i = 0; i < 4; ++i)
+				dst[i] = row[i] - above[i];
+			for (; i < bytes; ++i)
+				dst[i] = row[i] - png_paeth(row[i - 4], above[i], above[i - 4]);
+			break;
+	}
+}
+
+/* filter a band's rows, each with whichever filter leaves the lowest
+ * sum of absolute differences, like stb_image_write does; stored
+ * images aren't compressed, so their rows are left unfiltered
+ */
+static void png_filter_each(void *udata, int index)
+{
+	struct Png *png = udata;
+	uint8_t *scratch[2];
+	uint8_t *mem;
+	int stride = png->stride;
+	int y = index * png->rows;
+	int end = y + png->rows;
+	
+	if (end > png->h)
+		end = png->h;
+	
+	mem = malloc_safe(stride * 2);
+	scratch[0] = mem;
+	scratch[1] = mem + stride;
+	
+	for (; y < end; ++y)
+	{
+		const uint8_t *row = png->rgba + (size_t)y * stride;
+		const uint8_t *above = (y) ? row - stride : png->zero;
+		uint8_t *dst = png->filtered + (size_t)y * (stride + 1);
+		unsigned bestCost = ~0u;
+		int best = 0;
+		int type;
+		
+		if (!png->chain)
+		{
+			dst[0] = 0;
+			memcpy(dst + 1, row, stride);
+			continue;
+		}
+		
+		for (type = 0; type < 5; ++type)
+		{
+			unsigned cost = 0;
+			int i;
+			
+			png_filter_row(scratch[0], type, row, above, stride);
+			for (i = 0; i < stride; ++i)
+				cost += abs((signed char)scratch[0][i]);
+			
+			/* the best so far is kept in scratch[1] */
+			if (cost < bestCost)
+			{
+				uint8_t *swap = scratch[0];
+				
+				scratch[0] = scratch[1];
+				scratch[1] = swap;
+				bestCost = cost;
+				best = type;
+			}
+		}
+		
+		dst[0] = best;
+		memcpy(dst + 1, scratch[1], stride);
+	}
+	
+	free_safe(&mem);
+}
+
+static uint32_t png_hash(const uint8_t *b)
+{
+	uint32_t hash = b[0] + (b[1] << 8) + (b[2] << 16);
+	
+	hash ^= hash << 3;
+	hash += hash >> 5;
+	hash ^= hash << 4;
+	hash += hash >> 17;
+	hash ^= hash << 25;
+	hash += hash >> 6;
+	
+	return hash & (PNG_HASH - 1);
+}
+
+static int png_match(const uint8_t *a, const uint8_t *b, size_t limit)
+{
+	int i;
+	
+	if (limit > 258)
+		limit = 258;
+	
+	for (i = 0; i < (int)limit && a[i] == b[i]; ++i)
+		;
+	
+	return i;
+}
+
+/* compress a band as one block of fixed Huffman codes, the way
+ * stb_image_write does (the lazy matching included), except that
+ * the match finder is primed with the bytes preceding the band
+ */
+static void png_deflate_each(void *udata, int index)
+{
+	static const uint16_t lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259 };
+	static const uint8_t lengthBits[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32768 };
+	static const uint8_t distBits[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	struct Png *png = udata;
+	struct PngBand *band = png->band + index;
+	struct PngStream *out = &band->out;
+	const uint8_t *data = png->filtered;
+	size_t start = band->start;
+	size_t end = band->end;
+	size_t mark;
+	size_t *table;
+	uint8_t *fill;
+	size_t i;
+	int final = (index + 1) == png->bands;
+	int chain = png->chain;
+	
+	band->adler = png_adler(data + start, end - start);
+	
+	/* the zlib header: deflate, 32 KiB window, and a compression
+	 * level hint whose check bits make it a multiple of 31
+	 */
+	if (!index)
+	{
+		PngStream_byte(out, 0x78);
+		PngStream_byte(out, (!chain) ? 0x01 : (chain < 8) ? 0x5e : (chain == 8) ? 0x9c : 0xda);
+	}
+	mark = out->count;
+	
+	if (!chain)
+	{
+		PngStream_stored(out, data + start, end - start, final);
+		goto checksum;
+	}
+	
+	/* each bucket holds the last 'chain' to '2 * chain' positions */
+	table = malloc_safe(PNG_HASH * chain * 2 * sizeof(*table));
+	fill = calloc_safe(PNG_HASH, sizeof(*fill));
+#define PNG_INSERT(POS, HASH) \
+	{ \
+		size_t *bucket_ = table + (HASH) * chain * 2; \
+		uint8_t *fill_ = fill + (HASH); \
+		\
+		if (*fill_ == chain * 2) \
+		{ \
+			memmove(bucket_, bucket_ + chain, chain * sizeof(*bucket_)); \
+			*fill_ = chain; \
+		} \
+		bucket_[(*fill_)++] = (POS); \
+	}
+	
+	for (i = (start > PNG_WINDOW) ? start - PNG_WINDOW : 0; i < start; ++i)
+		PNG_INSERT(i, png_hash(data + i))
+	
+	PngStream_bits(out, final, 1); /* BFINAL */
+	PngStream_bits(out, 1, 2); /* BTYPE = 01, fixed Huffman codes */
+	
+	i = start;
+	while (i + 3 < end)
+	{
+		uint32_t hash = png_hash(data + i);
+		const size_t *bucket = table + hash * chain * 2;
+		int n = fill[hash];
+		int best = 3;
+		size_t bestPos = 0;
+		int found = 0;
+		int j;
+		
+		for (j = 0; j < n; ++j)
+		{
+			if (bucket[j] + PNG_WINDOW > i)
+			{
+				int d = png_match(data + bucket[j], data + i, end - i);
+				
+				if (d >= best)
+				{
+					best = d;
+					bestPos = bucket[j];
+					found = 1;
+				}
+			}
+		}
+		PNG_INSERT(i, hash)
+		
+		/* lazy matching: if the next byte starts a longer match,
+		 * write this byte as a literal instead
+		 */
+		if (found)
+		{
+			hash = png_hash(data + i + 1);
+			bucket = table + hash * chain * 2;
+			n = fill[hash];
+			
+			for (j = 0; j < n; ++j)
+			{
+				if (bucket[j] + PNG_WINDOW - 1 > i
+					&& png_match(data + bucket[j], data + i + 1, end - i - 1) > best
+				)
+				{
+					found = 0;
+					break;
+				}
+			}
+		}
+		
+		if (found)
+		{
+			int d = i - bestPos;
+			
+			for (j = 0; best > lengthBase[j + 1] - 1; ++j)
+				;
+			PngStream_symbol(out, j + 257);
+			if (lengthBits[j])
+				PngStream_bits(out, best - lengthBase[j], lengthBits[j]);
+			
+			for (j = 0; d > distBase[j + 1] - 1; ++j)
+				;
+			PngStream_code(out, j, 5);
+			if (distBits[j])
+				PngStream_bits(out, d - distBase[j], distBits[j]);
+			
+			i += best;
+		}
+		else
+			PngStream_symbol(out, data[i++]);
+	}
+#undef PNG_INSERT
+
+	for (; i < end; ++i)
+		PngStream_symbol(out, data[i]);
+	PngStream_symbol(out, 256); /* end of block */
+	
+	/* end on a byte boundary, so the next band can follow directly */
+	if (!final)
+	{
+		PngStream_bits(out, 0, 3);
+		PngStream_align(out);
+		PngStream_bytes(out, "\x00\x00\xff\xff", 4);
+	}
+	else
+		PngStream_align(out);
+	
+	free_safe(&table);
+	free_safe(&fill);
+	
+	/* store the band instead if compressing it made it bigger */
+	if (out->count - mark > (end - start) + ((end - start) / 65535 + 1) * 5)
+	{
+		out->count = mark;
+		PngStream_stored(out, data + start, end - start, final);
+	}
+
+checksum:
+	band->crc = png_crc(png, png_crc(png, ~0u, "IDAT", 4), out->data, out->count) ^ ~0u;
+}
+
+/* write 8-bit RGBA pixels to a PNG file, compressed at 'level'
+ * (0 = store only ... 9 = smallest) using 'jobs' threads
+ */
+void png_write(const char *fn, const void *rgba, int w, int h, int level, int jobs)
+{
+	static const int chains[] = { 0, 1, 2, 3, 4, 6, 8, 16, 32, 64 };
+	struct Png png = {0};
+	uint8_t ihdr[13] = {
+		w >> 24, w >> 16, w >> 8, w
+		, h >> 24, h >> 16, h >> 8, h
+		, 8 /* bits per channel */
+		, 6 /* RGBA */
+		, 0 /* deflate */
+		, 0 /* adaptive filtering */
+		, 0 /* not interlaced */
+	};
+	uint32_t adler = 1;
+	uint8_t sum[4];
+	FILE *fp;
+	int i;
+	
+	if (level < 0)
+		level = 0;
+	if (level >= ARRAY_COUNT(chains))
+		level = ARRAY_COUNT(chains) - 1;
+	
+	for (i = 0; i < 256; ++i)
+	{
+		uint32_t crc = i;
+		int k;
+		
+		for (k = 0; k < 8; ++k)
+			crc = (crc & 1) ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+		
+		png.crcTable[i] = crc;
+	}
+	
+	png.rgba = rgba;
+	png.stride = w * 4;
+	png.h = h;
+	png.chain = chains[level];
+	png.rows = PNG_BAND_BYTES / (png.stride + 1) + 1;
+	png.bands = (h + png.rows - 1) / png.rows;
+	png.filtered = malloc_safe((size_t)(png.stride + 1) * h);
+	png.zero = calloc_safe(png.stride, 1);
+	png.band = calloc_safe(png.bands, sizeof(*png.band));
+	
+	for (i = 0; i < png.bands; ++i)
+	{
+		struct PngBand *band = png.band + i;
+		int end = (i + 1) * png.rows;
+		
+		if (end > h)
+			end = h;
+		
+		band->start = (size_t)i * png.rows * (png.stride + 1);
+		band->end = (size_t)end * (png.stride + 1);
+	}
+	
+	/* every band is filtered before any is compressed, because
+	 * each band's dictionary is the end of the band before it
+	 */
+	worker_run(jobs, png.bands, png_filter_each, &png, 0);
+	worker_run(jobs, png.bands, png_deflate_each, &png, 0);
+	
+	fp = fopen_safe(fn, "wb");
+	fwrite("\x89PNG\r\n\x1a\n", 1, 8, fp);
+	png_chunk_small(fp, &png, "IHDR", ihdr, sizeof(ihdr));
+	for (i = 0; i < png.bands; ++i)
+	{
+		struct PngBand *band = png.band + i;
+		
+		png_chunk(fp, "IDAT", band->out.data, band->out.count, band->crc);
+		adler = png_adler_combine(adler, band->adler, band->end - band->start);
+		free_safe(&band->out.data);
+	}
+	sum[0] = adler >> 24;
+	sum[1] = adler >> 16;
+	sum[2] = adler >> 8;
+	sum[3] = adler;
+	png_chunk_small(fp, &png, "IDAT", sum, sizeof(sum));
+	png_chunk_small(fp, &png, "IEND", 0, 0);
+	fclose_safe(&fp);
+	
+	free_safe(&png.band);
+	free_safe(&png.zero);
+	free_safe(&png.filtered);
+}
@@ -22,6 +22,20 @@ void EzSpriteSheet_setPopups(
 	, void complain(const char *msg)
 	, void success(const char *msg)
 );
+void EzSpriteSheet_setJobs(int jobs);
+void EzSpriteSheet_setCache(const char *cache);
+void EzSpriteSheet_setMemory(int megabytes);
+void EzSpriteSheet_setScratch(const char *scratch);
+void EzSpriteSheet_setAreaAuto(int autoArea);
+void EzSpriteSheet_setIncremental(int percent);
+void EzSpriteSheet_setFit(const char *fit);
+void EzSpriteSheet_setOptimize(int ms);
+void EzSpriteSheet_setSeed(const char *seed);
+void EzSpriteSheet_setShrink(const char *shrink);
+void EzSpriteSheet_setGutter(int gutter);
+void EzSpriteSheet_setAlign(int align);
+void EzSpriteSheet_setPngLevel(int level);
+void EzSpriteSheet_setTexture(const char *texture);
 int EzSpriteSheet_countPages(void);
 void EzSpriteSheet_cleanup(void);
 const char *EzSpriteSheet_export(
@@ -13,8 +13,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define ROTATE_SSE2
+#endif
+
 #include <RectangleBinPack/GuillotineBinPack.h>
 #include <RectangleBinPack/MaxRectsBinPack.h>
+#include <RectangleBinPack/SkylineBinPack.h>
 
 /*
  * 
@@ -27,23 +33,43 @@ struct EzSpriteSheetRect
 	struct EzSpriteSheetRect *next;
 	struct EzSpriteSheetRect *nextInPage;
 	const void *udata;
-	int width;
+	uint64_t key; /* identifies the sprite across runs */
+	int width; /* footprint, rounded up to the list's alignment */
 	int height;
+	int cropWidth; /* size as pushed, which is never rotated */
+	int cropHeight;
 	int x;
 	int y;
 	int rotated;
 	int page;
 };
 
+struct EzSpriteSheetRectPageSize
+{
+	int width;
+	int height;
+	int stable; /* carried over as is by packIncremental() */
+};
+
 struct EzSpriteSheetRectList
 {
 	struct EzSpriteSheetRect *head;
 	struct EzSpriteSheetRect **page;
+	struct EzSpriteSheetRectPageSize *pageSize; /* after shrinking */
 	int count;
 	int pageCount;
 	int pageMax;
 	int pageWidth;
 	int pageHeight;
+	int choice; /* free rectangle choice heuristic */
+	int split; /* guillotine split heuristic */
+	enum EzSpriteSheetRectFit fit; /* page selection */
+	enum EzSpriteSheetRectPack mode; /* settings of most recent pack() */
+	int rotate;
+	int exhaustive;
+	int align; /* footprints (and thus placements) are multiples of this */
+	int margin; /* kept clear along each page's right and bottom edges */
+	double baseline; /* fill ratio of most recent full pack() */
 };
 
 struct Packer
@@ -52,9 +78,34 @@ struct Packer
 	{
 		GuillotineBinPackC *guillotine;
 		MaxRectsBinPackC *maxrects;
+		SkylineBinPackC *skyline;
 		void *ptr;
 	} handler;
 	enum EzSpriteSheetRectPack mode;
+	int choice;
+	int split;
+};
+
+/* heuristics offered by each packer, in RectangleBinPack's order */
+static const char *MaxRectsChoiceName[] =
+{
+	"BSSF", "BLSF", "BAF", "BL", "CP"
+};
+static const char *GuillotineChoiceName[] =
+{
+	"BAF", "BSSF", "BLSF", "WAF", "WSSF", "WLSF"
+};
+static const char *GuillotineSplitName[] =
+{
+	"SLAS", "LLAS", "MINAS", "MAXAS", "SAS", "LAS"
+};
+static const char *SkylineChoiceName[] =
+{
+	"BL", "MINW"
+};
+static const char *SortName[] =
+{
+	"area", "height", "width"
 };
 
 static void Packer_Free(struct Packer *p)
@@ -74,6 +125,10 @@ static void Packer_Free(struct Packer *p)
 		case EzSpriteSheetRectPack_Guillotine:
 			delete_GuillotineBinPack(p->handler.guillotine);
 			break;
+		case EzSpriteSheetRectPack_Skyline:
+		case EzSpriteSheetRectPack_SkylineWasteMap:
+			delete_SkylineBinPack(p->handler.skyline);
+			break;
 		default:
 			die("unsupported packer");
 			break;
@@ -98,7 +153,7 @@ static int Packer_Push(struct Packer *p, struct EzSpriteSheetRect *r)
 				p->handler.maxrects
 				, r->width
 				, r->height
-				, RectBestShortSideFit
+				, p->choice
 			);
 			break;
 		case EzSpriteSheetRectPack_Guillotine:
@@ -107,8 +162,17 @@ static int Packer_Push(struct Packer *p, struct EzSpriteSheetRect *r)
 				, r->width
 				, r->height
 				, 0
-				, RectBestAreaFit
-				, SplitShorterLeftoverAxis
+				, p->choice
+				, p->split
+			);
+			break;
+		case EzSpriteSheetRectPack_Skyline:
+		case EzSpriteSheetRectPack_SkylineWasteMap:
+			rv = SkylineBinPack_Insert(
+				p->handler.skyline
+				, r->width
+				, r->height
+				, p->choice
 			);
 			break;
 		default:
@@ -132,7 +196,7 @@ static int Packer_Push(struct Packer *p, struct EzSpriteSheetRect *r)
 }
 
 static void Packer_Init(struct Packer *p, enum EzSpriteSheetRectPack mode
-	, int width, int height, int rotate
+	, int width, int height, int rotate, int choice, int split
 )
 {
 	assert(p);
@@ -142,6 +206,8 @@ static void Packer_Init(struct Packer *p, enum EzSpriteSheetRectPack mode
 		return;
 	
 	p->mode = mode;
+	p->choice = choice;
+	p->split = split;
 	
 	switch (mode)
 	{
@@ -151,12 +217,27 @@ static void Packer_Init(struct Packer *p, enum EzSpriteSheetRectPack mode
 		case EzSpriteSheetRectPack_Guillotine:
 			p->handler.guillotine = new_GuillotineBinPack(width, height, rotate);
 			break;
+		case EzSpriteSheetRectPack_Skyline:
+			p->handler.skyline = new_SkylineBinPack(width, height, 0, rotate);
+			break;
+		case EzSpriteSheetRectPack_SkylineWasteMap:
+			p->handler.skyline = new_SkylineBinPack(width, height, 1, rotate);
+			break;
 		default:
 			die("unknown packer");
 			break;
 	}
 }
 
+/* mark a rectangle's existing placement as used (MaxRects only) */
+static void Packer_Place(struct Packer *p, const struct EzSpriteSheetRect *r)
+{
+	assert(p);
+	assert(p->mode == EzSpriteSheetRectPack_MaxRects);
+	
+	MaxRectsBinPack_Place(p->handler.maxrects, r->x, r->y, r->width, r->height);
+}
+
 /*
  * 
  * public interface
@@ -169,11 +250,50 @@ struct EzSpriteSheetRectList *EzSpriteSheetRectList_new(void)
 	struct EzSpriteSheetRectList *s = calloc_safe(1, sizeof(*s));
 	
 	s->pageMax = 64;
+	s->align = 1;
 	s->page = calloc_safe(s->pageMax, sizeof(*s->page));
+	s->pageSize = calloc_safe(s->pageMax, sizeof(*s->pageSize));
 	
 	return s;
 }
 
+/* round a size up to the list's alignment */
+int EzSpriteSheetRectList_alignUp(const struct EzSpriteSheetRectList *s, int size)
+{
+	assert(s);
+	
+	return (size + s->align - 1) / s->align * s->align;
+}
+
+/* make every rectangle pushed from now on take up a multiple of
+ * 'align' pixels in each dimension; every packer places rectangles
+ * against the page's edges and each other's, so their positions are
+ * multiples of it too, e.g. 4 keeps sprites from sharing the 4x4
+ * blocks of a block-compressed texture (get_crop() still reports
+ * the size that was pushed)
+ */
+void EzSpriteSheetRectList_setAlign(struct EzSpriteSheetRectList *s, int align)
+{
+	assert(s);
+	assert(!s->head);
+	
+	s->align = (align > 1) ? align : 1;
+}
+
+/* keep 'margin' pixels along the right and bottom edges of every page
+ * clear; rectangles are packed into what remains, so if each one is
+ * 'margin' pixels larger than its contents, and the contents are drawn
+ * 'margin' pixels right of and below where it's placed, neighbouring
+ * contents are always 'margin' pixels apart and from the page edges
+ * (a gutter that neighbours share, instead of each bringing its own)
+ */
+void EzSpriteSheetRectList_setMargin(struct EzSpriteSheetRectList *s, int margin)
+{
+	assert(s);
+	
+	s->margin = (margin > 0) ? margin : 0;
+}
+
 /* push a new rectangle into a rectangle list */
 struct EzSpriteSheetRect *EzSpriteSheetRectList_push(
 	struct EzSpriteSheetRectList *s
@@ -185,8 +305,10 @@ struct EzSpriteSheetRect *EzSpriteSheetRectList_push(
 	assert(s);
 	
 	r->udata = udata;
-	r->width = width;
-	r->height = height;
+	r->cropWidth = width;
+	r->cropHeight = height;
+	r->width = EzSpriteSheetRectList_alignUp(s, width);
+	r->height = EzSpriteSheetRectList_alignUp(s, height);
 	
 	r->next = s->head;
 	s->head = r;
@@ -197,74 +319,403 @@ struct EzSpriteSheetRect *EzSpriteSheetRectList_push(
 
 
 
+/* rectangles are sorted as an array, then relinked in sorted order */
+struct RectSortItem
+{
+	struct EzSpriteSheetRect *rect;
+	int index; /* position in list before sorting, for stable results */
+};
+
+/* compare two keys in descending order */
+#define DESCENDING(A, B) if ((A) != (B)) return ((A) < (B)) ? 1 : -1
+
+static int RectSort_tiebreak(const struct RectSortItem *a
+	, const struct RectSortItem *b
+)
+{
+	return (a->index > b->index) - (a->index < b->index);
+}
+
+/* sort by area, then height, then width */
+static int RectSort_area(const void *a_, const void *b_)
+{
+	const struct RectSortItem *a = a_;
+	const struct RectSortItem *b = b_;
+	
+	DESCENDING(a->rect->width * a->rect->height, b->rect->width * b->rect->height);
+	DESCENDING(a->rect->height, b->rect->height);
+	DESCENDING(a->rect->width, b->rect->width);
+	
+	return RectSort_tiebreak(a, b);
+}
+
+/* sort by height, then width */
+static int RectSort_height(const void *a_, const void *b_)
+{
+	const struct RectSortItem *a = a_;
+	const struct RectSortItem *b = b_;
+	
+	DESCENDING(a->rect->height, b->rect->height);
+	DESCENDING(a->rect->width, b->rect->width);
+	
+	return RectSort_tiebreak(a, b);
+}
+
+/* sort by width, then height */
+static int RectSort_width(const void *a_, const void *b_)
+{
+	const struct RectSortItem *a = a_;
+	const struct RectSortItem *b = b_;
+	
+	DESCENDING(a->rect->width, b->rect->width);
+	DESCENDING(a->rect->height, b->rect->height);
+	
+	return RectSort_tiebreak(a, b);
+}
+
+#undef DESCENDING
+
 /* sort a rectangle list (optional, but may improve packing speed/ratio)
- * adapted from the bubble sort example on GeeksforGeeks:
- * https://www.geeksforgeeks.org/c-program-bubble-sort-linked-list/
- * adapted from list_bubble_sort example here https://stackoverflow.com/a/21390410
+ * 
+ * the list is copied into an array, sorted in O(n log n), and relinked;
+ * ties are broken on the remaining dimensions and then on each
+ * rectangle's position in the list, so the order is deterministic
  */
 void EzSpriteSheetRectList_sort(struct EzSpriteSheetRectList *s
 	, enum EzSpriteSheetRectSort mode
 )
 {
+	int (*compare)(const void *a, const void *b) = 0;
+	struct RectSortItem *arr;
 	struct EzSpriteSheetRect *r;
-	int done = 0;
+	int i;
 	
 	if (!s || !s->head || s->count <= 1)
 		return;
 	
+	switch (mode)
+	{
+		case EzSpriteSheetRectSort_Area:
+			compare = RectSort_area;
+			break;
+		case EzSpriteSheetRectSort_Height:
+			compare = RectSort_height;
+			break;
+		case EzSpriteSheetRectSort_Width:
+			compare = RectSort_width;
+			break;
+		default:
+			die("unknown sort mode");
+			break;
+	}
+	
 	/* XXX you will have to rerun pack() after sorting */
-	for (r = s->head; r; r = r->next)
+	arr = malloc_safe(s->count * sizeof(*arr));
+	for (i = 0, r = s->head; r; r = r->next, ++i)
+	{
 		r->nextInPage = 0;
+		arr[i].rect = r;
+		arr[i].index = i;
+	}
+	assert(i == s->count);
+	
+	qsort(arr, s->count, sizeof(*arr), compare);
+	
+	/* relink in sorted order */
+	for (i = 0; i < s->count - 1; ++i)
+		arr[i].rect->next = arr[i + 1].rect;
+	arr[s->count - 1].rect->next = 0;
+	s->head = arr[0].rect;
+	
+	free_safe(&arr);
+	
+#if 0
+	/* print sorted area */
+	for (struct EzSpriteSheetRect *r = s->head; r; r = r->next)
+		fprintf(stderr, "area = %d\n", r->width * r->height);
+	fprintf(stderr, "%d rects\n", s->count);
+	exit(EXIT_FAILURE);
+#endif
+}
+
+/* while packing exhaustively, the rectangles not yet packed are found
+ * by index: a rectangle's skip entry points to the next one that may be
+ * unpacked (path compression keeps lookups nearly constant time), and
+ * the sizes that have failed to fit on the current page are kept so
+ * any rectangle at least that large in both dimensions is passed over
+ * without asking the packer; free space only ever shrinks as a page
+ * fills, so such a rectangle is guaranteed not to fit either
+ */
+struct UnpackedIndex
+{
+	struct EzSpriteSheetRect **rect; /* in list order */
+	int *skip;
+	struct
+	{
+		int w;
+		int h;
+	} *failed; /* sizes that didn't fit on the current page */
+	int failedCount;
+	int count;
+	int rotate;
+};
+
+static void UnpackedIndex_init(struct UnpackedIndex *idx
+	, struct EzSpriteSheetRectList *s
+	, int rotate
+)
+{
+	struct EzSpriteSheetRect *r;
+	int i;
 	
-	while (!done)
+	idx->count = s->count;
+	idx->rotate = rotate;
+	idx->failedCount = 0;
+	idx->rect = malloc_safe(s->count * sizeof(*idx->rect));
+	idx->skip = malloc_safe((s->count + 1) * sizeof(*idx->skip));
+	idx->failed = malloc_safe(s->count * sizeof(*idx->failed));
+	
+	for (i = 0, r = s->head; r; r = r->next, ++i)
 	{
-		struct EzSpriteSheetRect **pv = &s->head;
-		struct EzSpriteSheetRect *nd = s->head;
-		struct EzSpriteSheetRect *nx = s->head->next;
-		
-		done = 1;
+		idx->rect[i] = r;
+		idx->skip[i] = i;
+	}
+	idx->skip[s->count] = s->count;
+}
+
+static void UnpackedIndex_free(struct UnpackedIndex *idx)
+{
+	free_safe(&idx->rect);
+	free_safe(&idx->skip);
+	free_safe(&idx->failed);
+}
+
+/* index of the first unpacked rectangle at or after i (count if none) */
+static int UnpackedIndex_find(struct UnpackedIndex *idx, int i)
+{
+	int root = i;
+	
+	while (idx->skip[root] != root)
+		root = idx->skip[root];
+	
+	/* path compression */
+	while (idx->skip[i] != root)
+	{
+		int next = idx->skip[i];
+		idx->skip[i] = root;
+		i = next;
+	}
+	
+	return root;
+}
+
+static void UnpackedIndex_remove(struct UnpackedIndex *idx, int i)
+{
+	idx->skip[i] = i + 1;
+}
+
+/* dimensions are compared shortest side first when rotation is allowed,
+ * because then a rectangle fails only if neither orientation fits
+ */
+static void UnpackedIndex_dims(const struct UnpackedIndex *idx
+	, const struct EzSpriteSheetRect *r
+	, int *w
+	, int *h
+)
+{
+	*w = r->width;
+	*h = r->height;
+	
+	if (idx->rotate && *w > *h)
+	{
+		*w = r->height;
+		*h = r->width;
+	}
+}
+
+/* is the rectangle at least as large as one that has already failed? */
+static int UnpackedIndex_cannotFit(const struct UnpackedIndex *idx
+	, const struct EzSpriteSheetRect *r
+)
+{
+	int w;
+	int h;
+	int i;
+	
+	UnpackedIndex_dims(idx, r, &w, &h);
+	
+	for (i = 0; i < idx->failedCount; ++i)
+		if (w >= idx->failed[i].w && h >= idx->failed[i].h)
+			return 1;
+	
+	return 0;
+}
+
+static void UnpackedIndex_fail(struct UnpackedIndex *idx
+	, const struct EzSpriteSheetRect *r
+)
+{
+	int w;
+	int h;
+	int i;
+	int k;
+	
+	UnpackedIndex_dims(idx, r, &w, &h);
+	
+	/* only the smallest failures are worth keeping */
+	for (i = k = 0; i < idx->failedCount; ++i)
+		if (!(idx->failed[i].w >= w && idx->failed[i].h >= h))
+			idx->failed[k++] = idx->failed[i];
+	
+	idx->failed[k].w = w;
+	idx->failed[k].h = h;
+	idx->failedCount = k + 1;
+}
+
+/* ratio of rectangle area to the area of every full size page */
+static double EzSpriteSheetRectList_getFill(
+	const struct EzSpriteSheetRectList *s
+)
+{
+	const struct EzSpriteSheetRect *r;
+	double used = 0;
+	
+	if (!s->pageCount)
+		return 0;
+	
+	for (r = s->head; r; r = r->next)
+		used += (double)r->width * r->height;
+	
+	return used / ((double)s->pageCount * s->pageWidth * s->pageHeight);
+}
+
+/* every page starts out at full size after packing */
+static void EzSpriteSheetRectList_resetPageSizes(struct EzSpriteSheetRectList *s)
+{
+	int i;
+	
+	for (i = 0; i < s->pageCount; ++i)
+	{
+		s->pageSize[i].width = s->pageWidth;
+		s->pageSize[i].height = s->pageHeight;
+		s->pageSize[i].stable = 0;
+	}
+	
+	s->baseline = EzSpriteSheetRectList_getFill(s);
+}
+
+/* make room for at least one more page */
+static void EzSpriteSheetRectList_growPages(struct EzSpriteSheetRectList *s
+	, struct EzSpriteSheetRect *tail
+)
+{
+	int i;
+	
+	if (s->pageCount < s->pageMax)
+		return;
+	
+	s->pageMax = s->pageCount * 2;
+	s->page = realloc_safe(s->page, s->pageMax * sizeof(*s->page));
+	s->pageSize = realloc_safe(s->pageSize, s->pageMax * sizeof(*s->pageSize));
+	for (i = s->pageCount; i < s->pageMax; ++i)
+		s->page[i] = tail;
+}
+
+/* pack a rectangle list with every page kept open, one packer per
+ * page; each rectangle goes into the first page it fits into, in the
+ * order the pages were opened (first fit) or from fullest to emptiest
+ * (best fit), and a new page is opened only when it fits in none
+ */
+static void EzSpriteSheetRectList_packOpen(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectPack mode
+	, int width
+	, int height
+	, int rotate
+	, void progress(float unit_interval)
+)
+{
+	struct EzSpriteSheetRect *r;
+	struct Packer *packer = 0;
+	int64_t *used = 0; /* area occupied on each page */
+	int *order = 0; /* order in which pages are tried */
+	int packerMax = 0;
+	int num_packed = 0;
+	int i;
+	
+	s->pageCount = 0;
+	for (i = 0; i < s->pageMax; ++i)
+		s->page[i] = 0;
+	
+	for (r = s->head; r; r = r->next)
+	{
+		int page = -1;
+		int n;
 		
-		while (nx)
+		/* try each open page */
+		for (n = 0; n < s->pageCount; ++n)
 		{
-			struct EzSpriteSheetRect *p1 = nd;
-			struct EzSpriteSheetRect *p2 = nx;
-			int swap = 0;
-			
-			switch (mode)
+			if (!Packer_Push(packer + order[n], r))
 			{
-				case EzSpriteSheetRectSort_Area:
-					if (p1->width * p1->height < p2->width * p2->height)
-						swap = 1;
-					break;
-				case EzSpriteSheetRectSort_Height:
-					if (p1->height < p2->height)
-						swap = 1;
-					break;
-				case EzSpriteSheetRectSort_Width:
-					if (p1->width < p2->width)
-						swap = 1;
-					break;
+				page = order[n];
+				break;
 			}
-			if (swap)
+		}
+		
+		/* didn't fit into any of them, so open a new page */
+		if (page < 0)
+		{
+			EzSpriteSheetRectList_growPages(s, 0);
+			if (s->pageCount >= packerMax)
 			{
-				nd->next = nx->next;
-				nx->next = nd;
-				*pv = nx;
-				done = 0;
+				packerMax = s->pageMax;
+				packer = realloc_safe(packer, packerMax * sizeof(*packer));
+				used = realloc_safe(used, packerMax * sizeof(*used));
+				order = realloc_safe(order, packerMax * sizeof(*order));
 			}
-			pv = &nd->next;
-			nd = nx;
-			nx = nx->next;
+			
+			n = page = s->pageCount++;
+			memset(packer + page, 0, sizeof(*packer));
+			Packer_Init(packer + page, mode, width - s->margin, height - s->margin, rotate, s->choice, s->split);
+			used[page] = 0;
+			order[n] = page;
+			
+			if (Packer_Push(packer + page, r))
+				die("rectangle (%dx%d) doesn't fit on an empty page (%dx%d)"
+					, r->width, r->height, width, height
+				);
+		}
+		
+		/* link into list */
+		r->page = page;
+		r->nextInPage = s->page[page];
+		s->page[page] = r;
+		used[page] += (int64_t)r->width * r->height;
+		
+		/* keep the fullest pages first */
+		if (s->fit == EzSpriteSheetRectFit_Best)
+		{
+			for ( ; n > 0 && used[order[n - 1]] < used[page]; --n)
+				order[n] = order[n - 1];
+			order[n] = page;
 		}
+		
+		/* report progress */
+		if (progress)
+			progress(((float)num_packed) / s->count);
+		++num_packed;
 	}
 	
-#if 0
-	/* print sorted area */
-	for (struct EzSpriteSheetRect *r = s->head; r; r = r->next)
-		fprintf(stderr, "area = %d\n", r->width * r->height);
-	fprintf(stderr, "%d rects\n", s->count);
-	exit(EXIT_FAILURE);
-#endif
+	for (i = 0; i < s->pageCount; ++i)
+		Packer_Free(packer + i);
+	EzSpriteSheetRectList_resetPageSizes(s);
+	
+	/* report progress complete */
+	if (progress)
+		progress(2);
+	
+	free_safe(&packer);
+	free_safe(&used);
+	free_safe(&order);
 }
 
 /* pack a rectangle list into a series of pages */
@@ -279,8 +730,8 @@ void EzSpriteSheetRectList_pack(struct EzSpriteSheetRectList *s
 {
 	struct EzSpriteSheetRect tail = {0};
 	struct EzSpriteSheetRect *r;
+	struct UnpackedIndex idx = {0};
 	struct Packer p = {0};
-	int used_exhaustive = 0;
 	int num_packed = 0;
 	int hasPacked = 0;
 	int i;
@@ -292,92 +743,110 @@ void EzSpriteSheetRectList_pack(struct EzSpriteSheetRectList *s
 	
 	s->pageWidth = width;
 	s->pageHeight = height;
+	s->mode = mode;
+	s->rotate = rotate;
+	s->exhaustive = exhaustive;
 	
 	/* set each as having not been packed yet */
 	for (r = s->head; r; r = r->next)
 		r->nextInPage = 0;
 	
+	/* every page stays open (exhaustive is implied) */
+	if (s->fit != EzSpriteSheetRectFit_None)
+	{
+		EzSpriteSheetRectList_packOpen(s, mode, width, height, rotate, progress);
+		return;
+	}
+	
 	/* initialize each page in list as tail */
 	s->pageCount = 0;
 	for (i = 0; i < s->pageMax; ++i)
 		s->page[i] = &tail;
 	
 	/* initialize packer */
-	Packer_Init(&p, mode, width, height, rotate);
+	Packer_Init(&p, mode, width - s->margin, height - s->margin, rotate, s->choice, s->split);
+	UnpackedIndex_init(&idx, s, rotate);
 	
+	i = UnpackedIndex_find(&idx, 0);
 	while (num_packed < s->count)
 	{
-		for (r = s->head; r; r = r->next)
+		/* reached end of list, so go back over the ones skipped */
+		if (i >= s->count)
 		{
-	retry:
-			/* rectangle already packed */
-			if (r->nextInPage)
-				continue;
+			i = UnpackedIndex_find(&idx, 0);
+			continue;
+		}
+		r = idx.rect[i];
+		
+		/* rectangle didn't fit */
+		if ((exhaustive && UnpackedIndex_cannotFit(&idx, r))
+			|| Packer_Push(&p, r)
+		)
+		{
+			int filled = 1;
 			
-			/* rectangle didn't fit */
-			if (Packer_Push(&p, r))
+			/* try smaller and smaller ones until there is a fit */
+			if (exhaustive)
 			{
-				int filled = 1;
+				int k;
 				
-				/* try smaller and smaller ones until there is a fit */
-				if (exhaustive)
-				{
-					used_exhaustive = 1;
-					
-					for (r = r->next; r; r = r->next)
-					{
-						if (r->nextInPage)
-							continue;
-						
-						if (!Packer_Push(&p, r))
-						{
-							filled = 0;
-							break;
-						}
-					}
-				}
+				UnpackedIndex_fail(&idx, r);
 				
-				if (filled)
+				for (k = UnpackedIndex_find(&idx, i + 1)
+					; k < s->count
+					; k = UnpackedIndex_find(&idx, k + 1)
+				)
 				{
-					/* return to beginning of list to find largest unpacked rect */
-					if (used_exhaustive)
-					{
-						r = s->head;
-						used_exhaustive = 0;
-					}
+					r = idx.rect[k];
 					
-					s->pageCount++;
-					if (s->pageCount >= s->pageMax)
+					if (UnpackedIndex_cannotFit(&idx, r))
+						continue;
+					
+					if (!Packer_Push(&p, r))
 					{
-						int i;
-						
-						s->pageMax = s->pageCount * 2;
-						s->page = realloc_safe(s->page, s->pageMax * sizeof(*s->page));
-						for (i = s->pageCount; i < s->pageMax; ++i)
-							s->page[i] = &tail;
+						filled = 0;
+						i = k;
+						break;
 					}
 					
-					/* reinitialize packer */
-					Packer_Free(&p);
-					hasPacked = 0;
-					Packer_Init(&p, mode, width, height, rotate);
-					
-					/* try fitting this rectangle back into the page */
-					goto retry;
+					UnpackedIndex_fail(&idx, r);
 				}
 			}
 			
-			/* link into list */
-			//fprintf(stderr, "link %p into page %d\n", r, s->pageCount);
-			hasPacked = 1;
-			r->page = s->pageCount;
-			r->nextInPage = s->page[s->pageCount];
-			s->page[s->pageCount] = r;
-			
-			/* report progress */
-			if (progress)
-				progress(((float)(num_packed++)) / s->count);
+			if (filled)
+			{
+				/* return to beginning of list to find largest unpacked rect */
+				if (exhaustive)
+					i = UnpackedIndex_find(&idx, 0);
+				
+				s->pageCount++;
+				EzSpriteSheetRectList_growPages(s, &tail);
+				
+				/* reinitialize packer */
+				Packer_Free(&p);
+				hasPacked = 0;
+				idx.failedCount = 0;
+				Packer_Init(&p, mode, width - s->margin, height - s->margin, rotate, s->choice, s->split);
+				
+				/* try fitting this rectangle back into the page */
+				continue;
+			}
 		}
+		
+		/* link into list */
+		//fprintf(stderr, "link %p into page %d\n", r, s->pageCount);
+		hasPacked = 1;
+		r->page = s->pageCount;
+		r->nextInPage = s->page[s->pageCount];
+		s->page[s->pageCount] = r;
+		UnpackedIndex_remove(&idx, i);
+		
+		/* report progress */
+		if (progress)
+			progress(((float)num_packed) / s->count);
+		++num_packed;
+		
+		i = UnpackedIndex_find(&idx, i + 1);
 	}
 	
 	/* clear list tails back to 0 */
@@ -388,6 +857,8 @@ void EzSpriteSheetRectList_pack(struct EzSpriteSheetRectList *s
 	if (hasPacked)
 		s->pageCount++;
 	
+	EzSpriteSheetRectList_resetPageSizes(s);
+	
 	//for (i = 0; i < s->pageCount; ++i)
 	//	info("page[%d] head %p\n", i, s->page[i]);
 	
@@ -396,10 +867,1424 @@ void EzSpriteSheetRectList_pack(struct EzSpriteSheetRectList *s
 		progress(2);
 	
 	/* cleanup */
+	UnpackedIndex_free(&idx);
 	Packer_Free(&p);
 }
 
-void EzSpriteSheetRectList_pageDebugOverlay(struct EzSpriteSheetRectList *s
+/* select the heuristics used by subsequent calls to pack(); 0 and 0
+ * are the defaults (best short side fit for MaxRects, best area fit
+ * and shorter leftover axis split for Guillotine, bottom left for
+ * Skyline)
+ */
+void EzSpriteSheetRectList_setHeuristic(struct EzSpriteSheetRectList *s
+	, int choice
+	, int split
+)
+{
+	assert(s);
+	
+	s->choice = choice;
+	s->split = split;
+}
+
+/* select how subsequent calls to pack() choose pages */
+void EzSpriteSheetRectList_setFit(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectFit fit
+)
+{
+	assert(s);
+	
+	s->fit = fit;
+}
+
+/* make an unpacked copy of a rectangle list, in the same order;
+ * each copy's udata points back to the original rectangle
+ */
+static struct EzSpriteSheetRectList *EzSpriteSheetRectList_clone(
+	const struct EzSpriteSheetRectList *s
+)
+{
+	struct EzSpriteSheetRectList *clone = EzSpriteSheetRectList_new();
+	struct EzSpriteSheetRect **arr;
+	struct EzSpriteSheetRect *r;
+	int i;
+	
+	arr = malloc_safe(s->count * sizeof(*arr));
+	for (i = 0, r = s->head; r; r = r->next)
+		arr[i++] = r;
+	
+	/* pushing links at the head, so push in reverse */
+	clone->align = s->align;
+	clone->margin = s->margin;
+	while (i--)
+		EzSpriteSheetRectList_push(clone, arr[i], arr[i]->cropWidth, arr[i]->cropHeight);
+	
+	clone->choice = s->choice;
+	clone->split = s->split;
+	clone->fit = s->fit;
+	free_safe(&arr);
+	
+	return clone;
+}
+
+/* ratio of rectangle area to the area of each page's bounding box */
+static double EzSpriteSheetRectList_getOccupancy(
+	const struct EzSpriteSheetRectList *s
+)
+{
+	struct EzSpriteSheetRect *r;
+	double used = 0;
+	double total = 0;
+	int *right;
+	int *bottom;
+	int i;
+	
+	if (!s->pageCount)
+		return 0;
+	
+	right = calloc_safe(s->pageCount, sizeof(*right));
+	bottom = calloc_safe(s->pageCount, sizeof(*bottom));
+	
+	for (r = s->head; r; r = r->next)
+	{
+		if (r->x + r->width > right[r->page])
+			right[r->page] = r->x + r->width;
+		if (r->y + r->height > bottom[r->page])
+			bottom[r->page] = r->y + r->height;
+		used += (double)r->width * r->height;
+	}
+	
+	for (i = 0; i < s->pageCount; ++i)
+		total += (double)(right[i] + s->margin) * (bottom[i] + s->margin);
+	
+	free_safe(&right);
+	free_safe(&bottom);
+	
+	return total ? used / total : 0;
+}
+
+/* one combination of settings tried by packBest() */
+struct PackTrial
+{
+	enum EzSpriteSheetRectPack mode;
+	enum EzSpriteSheetRectSort sort;
+	int choice;
+	int split;
+	int pages; /* results */
+	double occupancy;
+};
+
+struct PackSearch
+{
+	const struct EzSpriteSheetRectList *list;
+	struct PackTrial *trial;
+	int width;
+	int height;
+	int rotate;
+	int exhaustive;
+};
+
+/* pack a copy of the list using one trial's settings (runs on a worker thread) */
+static void PackSearch_each(void *udata, int index)
+{
+	struct PackSearch *search = udata;
+	struct PackTrial *t = search->trial + index;
+	struct EzSpriteSheetRectList *clone;
+	
+	clone = EzSpriteSheetRectList_clone(search->list);
+	EzSpriteSheetRectList_setHeuristic(clone, t->choice, t->split);
+	EzSpriteSheetRectList_sort(clone, t->sort);
+	EzSpriteSheetRectList_pack(clone
+		, t->mode
+		, search->width
+		, search->height
+		, search->rotate
+		, search->exhaustive
+		, 0
+	);
+	
+	t->pages = clone->pageCount;
+	t->occupancy = EzSpriteSheetRectList_getOccupancy(clone);
+	
+	EzSpriteSheetRectList_free(&clone);
+}
+
+/* pack a rectangle list using every packer, heuristic, and sort order,
+ * across 'jobs' threads, and keep whichever combination yields the
+ * fewest pages (ties go to the densest, then to the first tried)
+ */
+void EzSpriteSheetRectList_packBest(struct EzSpriteSheetRectList *s
+	, int width
+	, int height
+	, int rotate
+	, int exhaustive
+	, int jobs
+	, void progress(float unit_interval)
+)
+{
+	struct PackSearch search = {0};
+	struct PackTrial *best;
+	struct PackTrial *t;
+	int count = 0;
+	int sort;
+	int choice;
+	int split;
+	int i;
+	
+	assert(s);
+	
+	if (!s || !s->head || !s->count)
+		return;
+	
+	/* enumerate every combination */
+	search.trial = calloc_safe(
+		ARRAY_COUNT(SortName) * (ARRAY_COUNT(MaxRectsChoiceName)
+			+ ARRAY_COUNT(GuillotineChoiceName) * ARRAY_COUNT(GuillotineSplitName)
+			+ ARRAY_COUNT(SkylineChoiceName) * 2
+		)
+		, sizeof(*search.trial)
+	);
+	for (sort = 0; sort < ARRAY_COUNT(SortName); ++sort)
+	{
+		for (choice = 0; choice < ARRAY_COUNT(MaxRectsChoiceName); ++choice)
+		{
+			t = search.trial + count++;
+			t->mode = EzSpriteSheetRectPack_MaxRects;
+			t->sort = sort;
+			t->choice = choice;
+		}
+		
+		for (choice = 0; choice < ARRAY_COUNT(GuillotineChoiceName); ++choice)
+		{
+			for (split = 0; split < ARRAY_COUNT(GuillotineSplitName); ++split)
+			{
+				t = search.trial + count++;
+				t->mode = EzSpriteSheetRectPack_Guillotine;
+				t->sort = sort;
+				t->choice = choice;
+				t->split = split;
+			}
+		}
+		
+		for (choice = 0; choice < ARRAY_COUNT(SkylineChoiceName); ++choice)
+		{
+			t = search.trial + count++;
+			t->mode = EzSpriteSheetRectPack_Skyline;
+			t->sort = sort;
+			t->choice = choice;
+			
+			t = search.trial + count++;
+			t->mode = EzSpriteSheetRectPack_SkylineWasteMap;
+			t->sort = sort;
+			t->choice = choice;
+		}
+	}
+	
+	search.list = s;
+	search.width = width;
+	search.height = height;
+	search.rotate = rotate;
+	search.exhaustive = exhaustive;
+	
+	worker_run(jobs, count, PackSearch_each, &search, progress);
+	
+	/* select the best result */
+	best = search.trial;
+	for (i = 1; i < count; ++i)
+	{
+		t = search.trial + i;
+		
+		if (t->pages < best->pages
+			|| (t->pages == best->pages && t->occupancy > best->occupancy)
+		)
+			best = t;
+	}
+	
+	/* packing is deterministic, so this reproduces the best result */
+	EzSpriteSheetRectList_setHeuristic(s, best->choice, best->split);
+	EzSpriteSheetRectList_sort(s, best->sort);
+	EzSpriteSheetRectList_pack(s, best->mode, width, height, rotate, exhaustive, 0);
+	
+	/* report progress complete */
+	if (progress)
+		progress(2);
+	
+	switch (best->mode)
+	{
+		case EzSpriteSheetRectPack_MaxRects:
+			info("Best method: MaxRects %s, sorted by %s"
+				, MaxRectsChoiceName[best->choice]
+				, SortName[best->sort]
+			);
+			break;
+		case EzSpriteSheetRectPack_Guillotine:
+			info("Best method: Guillotine %s %s, sorted by %s"
+				, GuillotineChoiceName[best->choice]
+				, GuillotineSplitName[best->split]
+				, SortName[best->sort]
+			);
+			break;
+		case EzSpriteSheetRectPack_Skyline:
+		case EzSpriteSheetRectPack_SkylineWasteMap:
+			info("Best method: Skyline %s%s, sorted by %s"
+				, SkylineChoiceName[best->choice]
+				, (best->mode == EzSpriteSheetRectPack_SkylineWasteMap)
+					? " with waste map" : ""
+				, SortName[best->sort]
+			);
+			break;
+	}
+	info("  %d page(s), %.2f%% occupancy"
+		, best->pages
+		, best->occupancy * 100
+	);
+	
+	free_safe(&search.trial);
+}
+
+/* where a rectangle was placed, saved while shrink() tries smaller pages */
+struct RectPlacement
+{
+	int x;
+	int y;
+	int width;
+	int height;
+	int rotated;
+};
+
+struct PageShrink
+{
+	struct EzSpriteSheetRectList *list;
+	struct EzSpriteSheetRect **rect; /* the page's rects, in packing order */
+	struct RectPlacement *best; /* smallest placement found so far */
+	int count;
+	int width; /* bounding box of best placement */
+	int height;
+};
+
+/* keep the current placement of each rectangle as the best one */
+static void PageShrink_keep(struct PageShrink *ps)
+{
+	int i;
+	
+	ps->width = ps->list->margin;
+	ps->height = ps->list->margin;
+	
+	for (i = 0; i < ps->count; ++i)
+	{
+		struct EzSpriteSheetRect *r = ps->rect[i];
+		struct RectPlacement *b = ps->best + i;
+		
+		b->x = r->x;
+		b->y = r->y;
+		b->width = r->width;
+		b->height = r->height;
+		b->rotated = r->rotated;
+		
+		if (r->x + r->width + ps->list->margin > ps->width)
+			ps->width = r->x + r->width + ps->list->margin;
+		if (r->y + r->height + ps->list->margin > ps->height)
+			ps->height = r->y + r->height + ps->list->margin;
+	}
+}
+
+/* repack a page's rectangles into a width x height page;
+ * returns non-zero and keeps the result if every one fit,
+ * restores the previous best placement otherwise
+ */
+static int PageShrink_try(struct PageShrink *ps, int width, int height)
+{
+	struct EzSpriteSheetRectList *s = ps->list;
+	struct Packer p = {0};
+	int fits = 1;
+	int i;
+	
+	/* no room left inside the margin */
+	if (width <= s->margin || height <= s->margin)
+		return 0;
+	
+	Packer_Init(&p, s->mode, width - s->margin, height - s->margin, s->rotate, s->choice, s->split);
+	
+	for (i = 0; i < ps->count && fits; ++i)
+	{
+		struct EzSpriteSheetRect *r = ps->rect[i];
+		struct RectPlacement *b = ps->best + i;
+		
+		/* packing swaps the dimensions of rotated rectangles */
+		r->width = (b->rotated) ? b->height : b->width;
+		r->height = (b->rotated) ? b->width : b->height;
+		
+		if (Packer_Push(&p, r))
+			fits = 0;
+	}
+	
+	Packer_Free(&p);
+	
+	if (fits)
+	{
+		PageShrink_keep(ps);
+		return 1;
+	}
+	
+	/* didn't fit, so put everything back */
+	for (i = 0; i < ps->count; ++i)
+	{
+		struct EzSpriteSheetRect *r = ps->rect[i];
+		struct RectPlacement *b = ps->best + i;
+		
+		r->x = b->x;
+		r->y = b->y;
+		r->width = b->width;
+		r->height = b->height;
+		r->rotated = b->rotated;
+	}
+	
+	return 0;
+}
+
+/* repack one page at progressively smaller dimensions until its
+ * contents no longer fit; the longer side is tried first, and the
+ * step size is halved whenever neither side can shrink by it
+ */
+static void EzSpriteSheetRectList_shrinkPage(struct EzSpriteSheetRectList *s
+	, int page
+)
+{
+	struct PageShrink ps = {0};
+	struct EzSpriteSheetRect *r;
+	int step;
+	int i;
+	
+	for (r = s->page[page]; r; r = r->nextInPage)
+		ps.count += 1;
+	
+	if (!ps.count)
+		return;
+	
+	ps.list = s;
+	ps.rect = malloc_safe(ps.count * sizeof(*ps.rect));
+	ps.best = malloc_safe(ps.count * sizeof(*ps.best));
+	
+	/* the page's rectangles, in the same order pack() placed them */
+	for (i = 0, r = s->head; r; r = r->next)
+		if (r->page == page)
+			ps.rect[i++] = r;
+	assert(i == ps.count);
+	
+	/* the bounding box of the existing placement always fits */
+	PageShrink_keep(&ps);
+	
+	step = ((ps.width > ps.height) ? ps.width : ps.height) / 2;
+	while (step > 0)
+	{
+		int w = ps.width;
+		int h = ps.height;
+		
+		if (w >= h)
+		{
+			if (!(w > step && PageShrink_try(&ps, w - step, h))
+				&& !(h > step && PageShrink_try(&ps, w, h - step))
+			)
+				step /= 2;
+		}
+		else
+		{
+			if (!(h > step && PageShrink_try(&ps, w, h - step))
+				&& !(w > step && PageShrink_try(&ps, w - step, h))
+			)
+				step /= 2;
+		}
+	}
+	
+	s->pageSize[page].width = ps.width;
+	s->pageSize[page].height = ps.height;
+	
+	free_safe(&ps.rect);
+	free_safe(&ps.best);
+}
+
+/* shrink the last page, or every page, to the smallest dimensions
+ * its contents can be repacked into (uses the settings of the most
+ * recent pack(), so only call this after packing); pages carried
+ * over unchanged by packIncremental() keep their previous size
+ */
+void EzSpriteSheetRectList_shrink(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectShrink mode
+)
+{
+	int i;
+	
+	assert(s);
+	
+	if (!s || !s->pageCount)
+		return;
+	
+	switch (mode)
+	{
+		case EzSpriteSheetRectShrink_None:
+			break;
+		case EzSpriteSheetRectShrink_Last:
+			if (!s->pageSize[s->pageCount - 1].stable)
+				EzSpriteSheetRectList_shrinkPage(s, s->pageCount - 1);
+			break;
+		case EzSpriteSheetRectShrink_All:
+			for (i = 0; i < s->pageCount; ++i)
+				if (!s->pageSize[i].stable)
+					EzSpriteSheetRectList_shrinkPage(s, i);
+			break;
+		default:
+			die("unknown shrink mode");
+			break;
+	}
+}
+
+/* one page size tried by findArea() */
+struct AreaTrial
+{
+	int width;
+	int height;
+	int pages; /* results (0 = not tried yet) */
+};
+
+struct AreaSearch
+{
+	const struct EzSpriteSheetRectList *list;
+	struct AreaTrial *trial;
+	int *probe; /* indices of the trials packed this round */
+	enum EzSpriteSheetRectPack mode;
+	int rotate;
+	int exhaustive;
+};
+
+/* pack a copy of the list at one trial's size (runs on a worker thread) */
+static void AreaSearch_each(void *udata, int index)
+{
+	struct AreaSearch *search = udata;
+	struct AreaTrial *t = search->trial + search->probe[index];
+	struct EzSpriteSheetRectList *clone;
+	
+	clone = EzSpriteSheetRectList_clone(search->list);
+	EzSpriteSheetRectList_pack(clone
+		, search->mode
+		, t->width
+		, t->height
+		, search->rotate
+		, search->exhaustive
+		, 0
+	);
+	
+	t->pages = clone->pageCount;
+	
+	EzSpriteSheetRectList_free(&clone);
+}
+
+/* does every rectangle fit on an empty width x height page? */
+static int EzSpriteSheetRectList_fitsEach(
+	const struct EzSpriteSheetRectList *s
+	, int width
+	, int height
+	, int rotate
+)
+{
+	const struct EzSpriteSheetRect *r;
+	
+	width -= s->margin;
+	height -= s->margin;
+	
+	for (r = s->head; r; r = r->next)
+	{
+		if (r->width <= width && r->height <= height)
+			continue;
+		
+		if (rotate && r->height <= width && r->width <= height)
+			continue;
+		
+		return 0;
+	}
+	
+	return 1;
+}
+
+static int AreaTrial_compare(const void *a_, const void *b_)
+{
+	const struct AreaTrial *a = a_;
+	const struct AreaTrial *b = b_;
+	int64_t areaA = (int64_t)a->width * a->height;
+	int64_t areaB = (int64_t)b->width * b->height;
+	int diffA = abs(a->width - a->height);
+	int diffB = abs(b->width - b->height);
+	
+	/* smallest area first, then squarest, then widest */
+	if (areaA != areaB)
+		return (areaA < areaB) ? -1 : 1;
+	if (diffA != diffB)
+		return (diffA < diffB) ? -1 : 1;
+	
+	return b->width - a->width;
+}
+
+/* find the smallest page size, no larger than maxWidth x maxHeight,
+ * that fits every rectangle in the list onto a single page; widths
+ * and heights are powers of two (the maximums are also considered),
+ * square or not, and are searched in order of increasing area, with
+ * up to 'jobs' candidates packed in parallel each round (0 = one per
+ * processor core); if nothing fits on one page, the maximum is used
+ * 
+ * packing depends on the list's order, so sort it first
+ */
+void EzSpriteSheetRectList_findArea(struct EzSpriteSheetRectList *s
+	, enum EzSpriteSheetRectPack mode
+	, int maxWidth
+	, int maxHeight
+	, int rotate
+	, int exhaustive
+	, int jobs
+	, int *width
+	, int *height
+)
+{
+	struct AreaSearch search = {0};
+	struct EzSpriteSheetRect *r;
+	int64_t used = 0;
+	int count = 0;
+	int lo;
+	int hi;
+	int top; /* the largest candidate has yet to be tried */
+	int w;
+	int h;
+	
+	assert(s);
+	assert(width);
+	assert(height);
+	
+	*width = maxWidth;
+	*height = maxHeight;
+	
+	if (!s || !s->head || !s->count)
+		return;
+	
+	if (jobs <= 0)
+		jobs = worker_count();
+	
+	for (r = s->head; r; r = r->next)
+		used += (int64_t)r->width * r->height;
+	
+	/* every power of two up to each maximum, and the maximum itself */
+	search.trial = calloc_safe(32 * 32, sizeof(*search.trial));
+	for (w = 1; ; w = (w < maxWidth / 2) ? w * 2 : maxWidth)
+	{
+		for (h = 1; ; h = (h < maxHeight / 2) ? h * 2 : maxHeight)
+		{
+			/* skip sizes that can't possibly fit everything on one page */
+			if ((int64_t)(w - s->margin) * (h - s->margin) >= used
+				&& EzSpriteSheetRectList_fitsEach(s, w, h, rotate)
+			)
+			{
+				search.trial[count].width = w;
+				search.trial[count].height = h;
+				++count;
+			}
+			
+			if (h == maxHeight)
+				break;
+		}
+		
+		if (w == maxWidth)
+			break;
+	}
+	
+	if (!count)
+	{
+		free_safe(&search.trial);
+		return;
+	}
+	
+	qsort(search.trial, count, sizeof(*search.trial), AreaTrial_compare);
+	
+	search.list = s;
+	search.probe = calloc_safe(jobs, sizeof(*search.probe));
+	search.mode = mode;
+	search.rotate = rotate;
+	search.exhaustive = exhaustive;
+	
+	/* the largest candidate is tried once, alongside the first round's
+	 * others, in case nothing fits on one page; every other probe sits
+	 * strictly inside the range, so a lone probe is a true midpoint, and
+	 * each round narrows the range to between the largest probe that
+	 * needed more than one page and the smallest one that didn't
+	 */
+	lo = 0;
+	hi = count - 1;
+	top = 1;
+	while (lo <= hi)
+	{
+		int inner = hi - lo + 1 - top; /* candidates below an untried 'hi' */
+		int probes = jobs - top;
+		int i;
+		
+		if (probes > inner)
+			probes = inner;
+		
+		/* spread probes evenly across the range, in ascending order */
+		for (i = 0; i < probes; ++i)
+			search.probe[i] = lo + (int)((int64_t)inner * (i + 1) / (probes + 1));
+		if (top)
+			search.probe[probes++] = hi;
+		top = 0;
+		
+		worker_run(jobs, probes, AreaSearch_each, &search, 0);
+		
+		for (i = 0; i < probes; ++i)
+		{
+			struct AreaTrial *t = search.trial + search.probe[i];
+			
+			if (t->pages == 1)
+			{
+				hi = search.probe[i] - 1;
+				break;
+			}
+			
+			lo = search.probe[i] + 1;
+		}
+		
+		/* nothing fits on one page */
+		if (search.trial[count - 1].pages != 1)
+			break;
+	}
+	
+	/* lo is now the smallest candidate known to fit on one page */
+	if (lo < count && search.trial[lo].pages == 1)
+	{
+		*width = search.trial[lo].width;
+		*height = search.trial[lo].height;
+	}
+	
+	free_safe(&search.trial);
+	free_safe(&search.probe);
+}
+
+static int RectKey_compare(const void *a_, const void *b_)
+{
+	const struct EzSpriteSheetRect *a = *(const struct EzSpriteSheetRect**)a_;
+	const struct EzSpriteSheetRect *b = *(const struct EzSpriteSheetRect**)b_;
+	
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+/* forget any placements made by packIncremental() */
+static void EzSpriteSheetRectList_unpack(struct EzSpriteSheetRectList *s)
+{
+	struct EzSpriteSheetRect *r;
+	
+	for (r = s->head; r; r = r->next)
+	{
+		if (r->rotated)
+		{
+			int tmp = r->width;
+			r->width = r->height;
+			r->height = tmp;
+		}
+		r->rotated = 0;
+		r->nextInPage = 0;
+		r->page = 0;
+		r->x = 0;
+		r->y = 0;
+	}
+	
+	s->pageCount = 0;
+}
+
+/* splitmix64, so any trial's order can be rebuilt from the seed and
+ * trial number alone, regardless of which thread ran it
+ */
+static uint64_t OptimizeRng_next(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	
+	return z ^ (z >> 31);
+}
+
+struct OptimizeOrder
+{
+	struct EzSpriteSheetRect *rect;
+	double key;
+	int index; /* position in list before reordering */
+};
+
+static int OptimizeOrder_compare(const void *a_, const void *b_)
+{
+	const struct OptimizeOrder *a = a_;
+	const struct OptimizeOrder *b = b_;
+	
+	if (a->key != b->key)
+		return (a->key < b->key) ? 1 : -1;
+	
+	return (a->index > b->index) - (a->index < b->index);
+}
+
+/* reorder an unpacked list for one optimizer trial: each rectangle is
+ * keyed on its area, height, or width (cycling every eight trials),
+ * scaled by a random factor of up to +/- 5% to 40% (cycling every
+ * trial), and the list is sorted on those keys in descending order,
+ * so big rectangles still tend to go first
+ */
+static void EzSpriteSheetRectList_reorder(struct EzSpriteSheetRectList *s
+	, uint64_t seed
+	, int trial
+)
+{
+	uint64_t state = seed ^ ((uint64_t)trial * 0xD1B54A32D192ED03ull);
+	double amplitude = 0.05 * (1 + trial % 8);
+	int basis = (trial / 8) % 3;
+	struct OptimizeOrder *arr;
+	struct EzSpriteSheetRect *r;
+	int i;
+	
+	if (s->count <= 1)
+		return;
+	
+	arr = malloc_safe(s->count * sizeof(*arr));
+	for (i = 0, r = s->head; r; r = r->next, ++i)
+	{
+		double unit = (OptimizeRng_next(&state) >> 11) * (1.0 / 9007199254740992.0);
+		double key;
+		
+		if (basis == 0)
+			key = (double)r->width * r->height;
+		else if (basis == 1)
+			key = r->height;
+		else
+			key = r->width;
+		
+		arr[i].rect = r;
+		arr[i].key = key * (1 + amplitude * (unit * 2 - 1));
+		arr[i].index = i;
+	}
+	
+	qsort(arr, s->count, sizeof(*arr), OptimizeOrder_compare);
+	
+	/* relink in the new order */
+	for (i = 0; i < s->count - 1; ++i)
+		arr[i].rect->next = arr[i + 1].rect;
+	arr[s->count - 1].rect->next = 0;
+	s->head = arr[0].rect;
+	
+	free_safe(&arr);
+}
+
+/* one reordering tried by optimize() */
+struct OptimizeTrial
+{
+	int pages; /* results */
+	double occupancy;
+};
+
+struct OptimizeSearch
+{
+	const struct EzSpriteSheetRectList *list;
+	struct OptimizeTrial *trial;
+	uint64_t seed;
+	int first; /* number of the round's first trial */
+};
+
+/* pack a reordered copy of the list (runs on a worker thread) */
+static void OptimizeSearch_each(void *udata, int index)
+{
+	struct OptimizeSearch *search = udata;
+	const struct EzSpriteSheetRectList *s = search->list;
+	struct OptimizeTrial *t = search->trial + index;
+	struct EzSpriteSheetRectList *clone;
+	
+	clone = EzSpriteSheetRectList_clone(s);
+	EzSpriteSheetRectList_reorder(clone, search->seed, search->first + index);
+	EzSpriteSheetRectList_pack(clone
+		, s->mode
+		, s->pageWidth
+		, s->pageHeight
+		, s->rotate
+		, s->exhaustive
+		, 0
+	);
+	
+	t->pages = clone->pageCount;
+	t->occupancy = EzSpriteSheetRectList_getOccupancy(clone);
+	
+	EzSpriteSheetRectList_free(&clone);
+}
+
+/* try to improve on a packed rectangle list for 'ms' milliseconds by
+ * packing it in other orders, using the settings of its most recent
+ * pack(), across 'jobs' threads; trials run in rounds of one per
+ * thread, and the order used by each is derived from 'seed' and its
+ * trial number, so the same seed always yields the same sequence of
+ * trials; the list is repacked in the order that yields the fewest
+ * pages (ties go to the densest, then to the first tried), but only
+ * if it beats the existing packing
+ * 
+ * if 'replay' is non-negative, that trial is reproduced and kept
+ * instead of searching; returns the number of the trial kept, or -1
+ */
+int EzSpriteSheetRectList_optimize(struct EzSpriteSheetRectList *s
+	, int ms
+	, uint64_t seed
+	, int replay
+	, int jobs
+	, void progress(float unit_interval)
+)
+{
+	struct OptimizeSearch search = {0};
+	struct OptimizeTrial best = {0};
+	int64_t start = worker_clock();
+	int64_t elapsed = 0;
+	int winner = replay;
+	int round;
+	int i;
+	
+	assert(s);
+	
+	if (!s || !s->head || !s->count || !s->pageCount)
+		return -1;
+	
+	if (replay < 0)
+	{
+		if (jobs <= 0)
+			jobs = worker_count();
+		round = jobs;
+		
+		best.pages = s->pageCount;
+		best.occupancy = EzSpriteSheetRectList_getOccupancy(s);
+		
+		search.list = s;
+		search.seed = seed;
+		search.trial = calloc_safe(round, sizeof(*search.trial));
+		
+		while (elapsed < ms)
+		{
+			worker_run(jobs, round, OptimizeSearch_each, &search, 0);
+			
+			for (i = 0; i < round; ++i)
+			{
+				struct OptimizeTrial *t = search.trial + i;
+				
+				if (t->pages < best.pages
+					|| (t->pages == best.pages && t->occupancy > best.occupancy)
+				)
+				{
+					best = *t;
+					winner = search.first + i;
+				}
+			}
+			
+			search.first += round;
+			elapsed = worker_clock() - start;
+			
+			if (progress)
+				progress(((float)elapsed) / ms);
+		}
+		
+		free_safe(&search.trial);
+		
+		/* report progress complete */
+		if (progress)
+			progress(2);
+		
+		info("Optimizer tried %d orders in %d ms", search.first, (int)elapsed);
+	}
+	
+	/* packing is deterministic, so this reproduces the trial */
+	if (winner >= 0)
+	{
+		enum EzSpriteSheetRectPack mode = s->mode;
+		
+		EzSpriteSheetRectList_unpack(s);
+		EzSpriteSheetRectList_reorder(s, seed, winner);
+		EzSpriteSheetRectList_pack(s
+			, mode
+			, s->pageWidth
+			, s->pageHeight
+			, s->rotate
+			, s->exhaustive
+			, 0
+		);
+		
+		info("Optimizer kept trial %d (reproduce with --seed %llu:%d)"
+			, winner
+			, (unsigned long long)seed
+			, winner
+		);
+		info("  %d page(s), %.2f%% occupancy"
+			, s->pageCount
+			, EzSpriteSheetRectList_getOccupancy(s) * 100
+		);
+	}
+	else
+		info("Optimizer found nothing better than the initial packing");
+	
+	return winner;
+}
+
+/* pack a rectangle list using the placements of a previous one, so
+ * the sprites that exist in both stay where they were; each sprite
+ * is matched by key, and keeps its placement if it is still the same
+ * size; the rest are placed into the first page they fit into, each
+ * page seeded with its existing placements, or onto new pages, and
+ * pages left empty are dropped
+ * 
+ * the result is rejected if any new sprite doesn't fit on an empty
+ * page, or if the ratio of sprite area to page area falls below
+ * 'threshold' times that of the last full pack() in the lineage;
+ * returns 0 on success, non-zero if the list still needs packing
+ * 
+ * MaxRects is the only packer that can be seeded with arbitrary
+ * placements, so it places the new sprites regardless of the method
+ * used for the previous list
+ */
+int EzSpriteSheetRectList_packIncremental(struct EzSpriteSheetRectList *s
+	, const struct EzSpriteSheetRectList *prev
+	, float threshold
+	, void progress(float unit_interval)
+)
+{
+	struct EzSpriteSheetRect tail = {0};
+	struct EzSpriteSheetRect **old;
+	struct EzSpriteSheetRect *r;
+	struct Packer *packer;
+	int *remap; /* old page index -> new page index */
+	int *dirty; /* page received new sprites */
+	int width;
+	int height;
+	int pageMax;
+	int pageCount;
+	int kept = 0;
+	int changed = 0;
+	int i;
+	
+	assert(s);
+	assert(prev);
+	
+	if (!s || !s->head || !s->count || !prev || !prev->pageCount)
+		return 1;
+	
+	width = prev->pageWidth;
+	height = prev->pageHeight;
+	s->pageWidth = width;
+	s->pageHeight = height;
+	s->mode = prev->mode;
+	s->rotate = prev->rotate;
+	s->choice = prev->choice;
+	s->split = prev->split;
+	s->fit = prev->fit;
+	
+	/* look up previous placements by key */
+	old = malloc_safe(prev->count * sizeof(*old));
+	for (i = 0, r = prev->head; r; r = r->next)
+		old[i++] = r;
+	qsort(old, prev->count, sizeof(*old), RectKey_compare);
+	
+	/* sprites that are still the same size stay where they were */
+	for (r = s->head; r; r = r->next)
+	{
+		struct EzSpriteSheetRect **found;
+		const struct EzSpriteSheetRect *o;
+		int w;
+		int h;
+		
+		r->nextInPage = 0;
+		r->rotated = 0;
+		
+		found = bsearch(&r, old, prev->count, sizeof(*old), RectKey_compare);
+		if (!found)
+			continue;
+		o = *found;
+		
+		/* packing swaps the dimensions of rotated rectangles */
+		w = (o->rotated) ? o->height : o->width;
+		h = (o->rotated) ? o->width : o->height;
+		if (w != r->width || h != r->height)
+			continue;
+		
+		r->x = o->x;
+		r->y = o->y;
+		r->width = o->width;
+		r->height = o->height;
+		r->rotated = o->rotated;
+		r->page = o->page;
+		r->nextInPage = &tail;
+		++kept;
+	}
+	free_safe(&old);
+	
+	pageMax = prev->pageCount + 1;
+	pageCount = prev->pageCount;
+	packer = calloc_safe(pageMax, sizeof(*packer));
+	dirty = calloc_safe(pageMax, sizeof(*dirty));
+	
+	/* place everything else, opening new pages as needed */
+	for (r = s->head; r; r = r->next)
+	{
+		int page;
+		
+		if (r->nextInPage)
+			continue;
+		
+		for (page = 0; ; ++page)
+		{
+			struct Packer *p;
+			
+			if (page == pageCount)
+			{
+				if (pageCount == pageMax)
+				{
+					pageMax *= 2;
+					packer = realloc_safe(packer, pageMax * sizeof(*packer));
+					dirty = realloc_safe(dirty, pageMax * sizeof(*dirty));
+				}
+				memset(packer + page, 0, sizeof(*packer));
+				dirty[page] = 0;
+				++pageCount;
+			}
+			p = packer + page;
+			
+			/* seed each page's packer with its existing placements */
+			if (!p->handler.ptr)
+			{
+				struct EzSpriteSheetRect *w;
+				
+				Packer_Init(p
+					, EzSpriteSheetRectPack_MaxRects
+					, width - s->margin
+					, height - s->margin
+					, s->rotate
+					, (s->mode == EzSpriteSheetRectPack_MaxRects) ? s->choice : 0
+					, 0
+				);
+				
+				for (w = s->head; w; w = w->next)
+					if (w->nextInPage && w->page == page)
+						Packer_Place(p, w);
+			}
+			
+			if (!Packer_Push(p, r))
+				break;
+			
+			/* doesn't fit on an empty page */
+			if (page >= prev->pageCount && !dirty[page])
+			{
+				for (i = 0; i < pageCount; ++i)
+					if (packer[i].handler.ptr)
+						Packer_Free(packer + i);
+				free_safe(&packer);
+				free_safe(&dirty);
+				EzSpriteSheetRectList_unpack(s);
+				return 1;
+			}
+		}
+		
+		r->page = page;
+		r->nextInPage = &tail;
+		dirty[page] = 1;
+	}
+	
+	for (i = 0; i < pageCount; ++i)
+		if (packer[i].handler.ptr)
+			Packer_Free(packer + i);
+	free_safe(&packer);
+	
+	/* drop pages left empty */
+	remap = malloc_safe(pageCount * sizeof(*remap));
+	for (i = 0; i < pageCount; ++i)
+		remap[i] = -1;
+	for (r = s->head; r; r = r->next)
+		remap[r->page] = 0;
+	for (s->pageCount = i = 0; i < pageCount; ++i)
+		if (remap[i] >= 0)
+			remap[i] = s->pageCount++;
+	
+	/* link each rectangle into its page */
+	while (s->pageCount >= s->pageMax)
+		EzSpriteSheetRectList_growPages(s, 0);
+	for (i = 0; i < s->pageCount; ++i)
+		s->page[i] = 0;
+	for (r = s->head; r; r = r->next)
+	{
+		r->page = remap[r->page];
+		r->nextInPage = s->page[r->page];
+		s->page[r->page] = r;
+	}
+	
+	/* pages that didn't receive new sprites keep their previous size */
+	for (i = 0; i < pageCount; ++i)
+	{
+		struct EzSpriteSheetRectPageSize *size;
+		
+		if (remap[i] < 0)
+			continue;
+		
+		size = s->pageSize + remap[i];
+		if (i < prev->pageCount && !dirty[i])
+		{
+			*size = prev->pageSize[i];
+			size->stable = 1;
+		}
+		else
+		{
+			size->width = width;
+			size->height = height;
+			size->stable = 0;
+			++changed;
+		}
+	}
+	free_safe(&remap);
+	free_safe(&dirty);
+	
+	/* too much space wasted, so start over */
+	s->baseline = prev->baseline;
+	if (EzSpriteSheetRectList_getFill(s) < s->baseline * threshold)
+	{
+		info("Incremental packing fill fell below threshold, repacking");
+		EzSpriteSheetRectList_unpack(s);
+		return 1;
+	}
+	
+	/* report progress complete */
+	if (progress)
+		progress(2);
+	
+	info("Incremental packing kept %d of %d sprite(s) in place,"
+		" %d page(s) changed"
+		, kept
+		, s->count
+		, changed
+	);
+	
+	return 0;
+}
+
+/* every layout file begins with this header, followed by the size of
+ * each page, then the placement of each rectangle
+ */
+struct LayoutHeader
+{
+	char     magic[8];
+	int32_t  version;
+	int32_t  count;
+	uint64_t signature; /* settings the layout was packed with */
+	int32_t  pageCount;
+	int32_t  pageWidth;
+	int32_t  pageHeight;
+	int32_t  mode;
+	int32_t  rotate;
+	int32_t  choice;
+	int32_t  split;
+	int32_t  fit;
+	double   baseline;
+};
+
+struct LayoutPage
+{
+	int32_t  width;
+	int32_t  height;
+};
+
+struct LayoutRect
+{
+	uint64_t key;
+	int32_t  x;
+	int32_t  y;
+	int32_t  width;
+	int32_t  height;
+	int32_t  rotated;
+	int32_t  page;
+};
+
+#define LAYOUT_MAGIC "EZSSLAYT"
+#define LAYOUT_VERSION 1
+
+/* save the placement of every rectangle in a packed list, so a later
+ * run can pass it to packIncremental() (see readLayout())
+ */
+int EzSpriteSheetRectList_writeLayout(const struct EzSpriteSheetRectList *s
+	, const char *fn
+	, uint64_t signature
+)
+{
+	struct LayoutHeader head = {0};
+	const struct EzSpriteSheetRect *r;
+	char tmpfn[4096 + 8];
+	FILE *fp;
+	int i;
+	
+	assert(s);
+	assert(fn);
+	
+	memcpy(head.magic, LAYOUT_MAGIC, sizeof(head.magic));
+	head.version = LAYOUT_VERSION;
+	head.count = s->count;
+	head.signature = signature;
+	head.pageCount = s->pageCount;
+	head.pageWidth = s->pageWidth;
+	head.pageHeight = s->pageHeight;
+	head.mode = s->mode;
+	head.rotate = s->rotate;
+	head.choice = s->choice;
+	head.split = s->split;
+	head.fit = s->fit;
+	head.baseline = s->baseline;
+	
+	/* write to a temporary file, then rename it */
+	snprintf(tmpfn, sizeof(tmpfn), "%s.tmp", fn);
+	if (!(fp = fopen(tmpfn, "wb")))
+	{
+		complain("failed to write layout file '%s'", tmpfn);
+		return 1;
+	}
+	
+	fwrite(&head, 1, sizeof(head), fp);
+	
+	for (i = 0; i < s->pageCount; ++i)
+	{
+		struct LayoutPage page = {0};
+		
+		page.width = s->pageSize[i].width;
+		page.height = s->pageSize[i].height;
+		
+		fwrite(&page, 1, sizeof(page), fp);
+	}
+	
+	for (r = s->head; r; r = r->next)
+	{
+		struct LayoutRect rect = {0};
+		
+		rect.key = r->key;
+		rect.x = r->x;
+		rect.y = r->y;
+		rect.width = r->width;
+		rect.height = r->height;
+		rect.rotated = r->rotated;
+		rect.page = r->page;
+		
+		fwrite(&rect, 1, sizeof(rect), fp);
+	}
+	
+	/* fclose() flushes, so it can fail to write, too */
+	if (ferror(fp) | fclose(fp))
+	{
+		remove(tmpfn);
+		complain("failed to write layout file '%s'", tmpfn);
+		return 1;
+	}
+	
+	remove(fn);
+	if (rename(tmpfn, fn))
+	{
+		remove(tmpfn);
+		complain("failed to write layout file '%s'", fn);
+		return 1;
+	}
+	
+	return 0;
+}
+
+/* load a layout saved by writeLayout(); returns 0 if there is none, or
+ * if it was packed using settings other than those in 'signature'
+ * 
+ * the rectangles in the returned list have no udata, and are meant only
+ * to be passed to packIncremental() as the previous list
+ */
+struct EzSpriteSheetRectList *EzSpriteSheetRectList_readLayout(const char *fn
+	, uint64_t signature
+)
+{
+	struct EzSpriteSheetRectList *s;
+	struct LayoutHeader head;
+	FILE *fp;
+	int i;
+	
+	assert(fn);
+	
+	if (file_stat(fn, 0, 0))
+		return 0;
+	
+	/* unreadable (or just removed) layouts are treated as missing */
+	if (!(fp = fopen(fn, "rb")))
+		return 0;
+	
+	if (fread(&head, 1, sizeof(head), fp) != sizeof(head)
+		|| memcmp(head.magic, LAYOUT_MAGIC, sizeof(head.magic))
+		|| head.version != LAYOUT_VERSION
+		|| head.signature != signature
+		|| head.count <= 0
+		|| head.pageCount <= 0
+		|| head.pageWidth <= 0
+		|| head.pageHeight <= 0
+	)
+	{
+		fclose_safe(&fp);
+		return 0;
+	}
+	
+	s = EzSpriteSheetRectList_new();
+	s->pageWidth = head.pageWidth;
+	s->pageHeight = head.pageHeight;
+	s->mode = head.mode;
+	s->rotate = head.rotate;
+	s->choice = head.choice;
+	s->split = head.split;
+	s->fit = head.fit;
+	s->baseline = head.baseline;
+	s->pageCount = head.pageCount;
+	while (s->pageCount >= s->pageMax)
+		EzSpriteSheetRectList_growPages(s, 0);
+	
+	for (i = 0; i < head.pageCount; ++i)
+	{
+		struct LayoutPage page;
+		
+		if (fread(&page, 1, sizeof(page), fp) != sizeof(page))
+			goto fail;
+		
+		s->pageSize[i].width = page.width;
+		s->pageSize[i].height = page.height;
+		s->pageSize[i].stable = 0;
+		s->page[i] = 0;
+	}
+	
+	for (i = 0; i < head.count; ++i)
+	{
+		struct EzSpriteSheetRect *r;
+		struct LayoutRect rect;
+		
+		if (fread(&rect, 1, sizeof(rect), fp) != sizeof(rect)
+			|| rect.page < 0
+			|| rect.page >= s->pageCount
+		)
+			goto fail;
+		
+		r = EzSpriteSheetRectList_push(s, 0, rect.width, rect.height);
+		r->key = rect.key;
+		r->x = rect.x;
+		r->y = rect.y;
+		r->rotated = rect.rotated;
+		r->page = rect.page;
+		r->nextInPage = s->page[r->page];
+		s->page[r->page] = r;
+	}
+	
+	fclose_safe(&fp);
+	
+	return s;
+
+fail:
+	EzSpriteSheetRectList_free(&s);
+	fclose_safe(&fp);
+	
+	return 0;
+}
+
+void EzSpriteSheetRectList_pageDebugOverlay(struct EzSpriteSheetRectList *s
 	, int page, void *p_, int w, int h, uint8_t opacity
 )
 {
@@ -447,16 +2332,198 @@ void EzSpriteSheetRectList_get_biggest_page(struct EzSpriteSheetRectList *s
 	, int *w, int *h
 )
 {
+	int i;
+	
 	assert(s);
 	assert(w);
 	assert(h);
 	
-	/* TODO one eventual optimization might be to continually re-process
-	 * the last page with increasingly smaller dimensions until nothing
-	 * else fits, to minimize wasted pixels
-	 */
-	*w = s->pageWidth;
-	*h = s->pageHeight;
+	/* pages may have been shrunk individually */
+	*w = 0;
+	*h = 0;
+	for (i = 0; i < s->pageCount; ++i)
+	{
+		if (s->pageSize[i].width > *w)
+			*w = s->pageSize[i].width;
+		if (s->pageSize[i].height > *h)
+			*h = s->pageSize[i].height;
+	}
+	
+	/* nothing packed yet */
+	if (!*w || !*h)
+	{
+		*w = s->pageWidth;
+		*h = s->pageHeight;
+	}
+}
+
+/* the part of a page a sprite's pixels are copied to */
+struct PageSpan
+{
+	const struct EzSpriteSheetRect *rect;
+	struct EzSpriteSheetAnim *anim; /* the sprite's animation */
+	int x;
+	int y;
+	int w;
+	int h;
+};
+
+static int PageSpan_compare(const void *a_, const void *b_)
+{
+	const struct PageSpan *a = a_;
+	const struct PageSpan *b = b_;
+	
+	if (a->y != b->y)
+		return (a->y > b->y) - (a->y < b->y);
+	
+	return (a->x > b->x) - (a->x < b->x);
+}
+
+/* groups spans by animation */
+static int PageSpan_compareAnim(const void *a_, const void *b_)
+{
+	const struct PageSpan *a = a_;
+	const struct PageSpan *b = b_;
+	uintptr_t aAnim = (uintptr_t)a->anim;
+	uintptr_t bAnim = (uintptr_t)b->anim;
+	
+	if (aAnim != bAnim)
+		return (aAnim > bAnim) - (aAnim < bAnim);
+	
+	return PageSpan_compare(a_, b_);
+}
+
+/* zero the pixels of a page that no span covers, one row at a time;
+ * spans are sorted by the row they start on, and the ones crossing
+ * the current row are kept sorted left to right, so each row is
+ * cleared in the gaps between them
+ */
+static void PageSpan_clearUncovered(uint32_t *p, int w, int h
+	, struct PageSpan *span
+	, int count
+)
+{
+	struct PageSpan **active = malloc_safe((count + 1) * sizeof(*active));
+	int numActive = 0;
+	int next = 0;
+	int y;
+	
+	qsort(span, count, sizeof(*span), PageSpan_compare);
+	
+	for (y = 0; y < h; ++y)
+	{
+		uint32_t *row = p + y * w;
+		int x = 0;
+		int i;
+		int k;
+		
+		/* drop spans ending above this row */
+		for (i = k = 0; i < numActive; ++i)
+			if (active[i]->y + active[i]->h > y)
+				active[k++] = active[i];
+		numActive = k;
+		
+		/* add spans starting on this row, keeping them sorted */
+		for (; next < count && span[next].y <= y; ++next)
+		{
+			struct PageSpan *add = span + next;
+			
+			if (add->y + add->h <= y)
+				continue;
+			
+			for (i = numActive++; i > 0 && active[i - 1]->x > add->x; --i)
+				active[i] = active[i - 1];
+			active[i] = add;
+		}
+		
+		for (i = 0; i < numActive; ++i)
+		{
+			if (active[i]->x > x)
+				memset(row + x, 0, (active[i]->x - x) * sizeof(*row));
+			x = active[i]->x + active[i]->w;
+		}
+		
+		if (x < w)
+			memset(row + x, 0, (w - x) * sizeof(*row));
+	}
+	
+	free_safe(&active);
+}
+
+/* copy a w x h block of pixels rotated 90 degrees counter clockwise,
+ * so the rightmost column of src becomes the top row of dst, which
+ * is h pixels wide and w tall; the copy goes in 32x32 tiles so the
+ * reads and writes of each tile stay in cache, and each tile is
+ * transposed 4x4 pixels at a time where SSE2 is available
+ */
+static void rotate_ccw(uint32_t *dst, int dstStride
+	, const uint32_t *src, int srcStride
+	, int w, int h
+)
+{
+	enum { TILE = 32 };
+	int tx;
+	int ty;
+	
+	for (ty = 0; ty < w; ty += TILE)
+	{
+		for (tx = 0; tx < h; tx += TILE)
+		{
+			int x1 = (tx + TILE < h) ? tx + TILE : h; /* dst columns, src rows */
+			int y1 = (ty + TILE < w) ? ty + TILE : w; /* dst rows, flipped src columns */
+			int x = tx;
+			int y;
+		
+		#ifdef ROTATE_SSE2
+			for (; x + 4 <= x1; x += 4)
+			{
+				for (y = ty; y + 4 <= y1; y += 4)
+				{
+					/* src columns w - 4 - y through w - 1 - y */
+					const uint32_t *s = src + x * srcStride + (w - 4 - y);
+					__m128i r0 = _mm_loadu_si128((const __m128i*)(s));
+					__m128i r1 = _mm_loadu_si128((const __m128i*)(s + srcStride));
+					__m128i r2 = _mm_loadu_si128((const __m128i*)(s + srcStride * 2));
+					__m128i r3 = _mm_loadu_si128((const __m128i*)(s + srcStride * 3));
+					__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+					__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+					__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+					__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+					uint32_t *d = dst + y * dstStride + x;
+					
+					/* rightmost column goes on top */
+					_mm_storeu_si128((__m128i*)(d), _mm_unpackhi_epi64(t2, t3));
+					_mm_storeu_si128((__m128i*)(d + dstStride), _mm_unpacklo_epi64(t2, t3));
+					_mm_storeu_si128((__m128i*)(d + dstStride * 2), _mm_unpackhi_epi64(t0, t1));
+					_mm_storeu_si128((__m128i*)(d + dstStride * 3), _mm_unpacklo_epi64(t0, t1));
+				}
+				
+				/* leftover rows of this column strip */
+				for (; y < y1; ++y)
+				{
+					uint32_t *d = dst + y * dstStride + x;
+					const uint32_t *s = src + x * srcStride + (w - 1 - y);
+					
+					d[0] = s[0];
+					d[1] = s[srcStride];
+					d[2] = s[srcStride * 2];
+					d[3] = s[srcStride * 3];
+				}
+			}
+		#endif
+		
+			/* leftover columns */
+			for (y = ty; y < y1; ++y)
+			{
+				uint32_t *d = dst + y * dstStride;
+				const uint32_t *s = src + (w - 1 - y);
+				int k;
+				
+				for (k = x; k < x1; ++k)
+					d[k] = s[k * srcStride];
+			}
+		}
+	}
 }
 
 void *EzSpriteSheetRectList_page(struct EzSpriteSheetRectList *s
@@ -472,8 +2539,13 @@ void *EzSpriteSheetRectList_page(struct EzSpriteSheetRectList *s
 )
 {
 	struct EzSpriteSheetRect *r;
+	struct PageSpan *span;
 	uint32_t *p = p_;
+	uint32_t *unrotated = 0; /* rotated sprites are drawn here first */
+	int unrotatedSize = 0;
 	static int copied = 0; /* num sprites copied so far */
+	int count = 0;
+	int i;
 	
 	assert(s);
 	assert(w);
@@ -482,28 +2554,77 @@ void *EzSpriteSheetRectList_page(struct EzSpriteSheetRectList *s
 	assert(rects);
 	assert(page < s->pageCount);
 	
-	/* reset counter on first page (progress bar hack) */
-	if (!progress || page == 0)
+	/* reset counter on first page (progress bar hack); pages baked
+	 * without progress reports leave it alone, as they may be baked
+	 * concurrently
+	 */
+	if (progress && page == 0)
 		copied = 0;
 	
-	*w = s->pageWidth;
-	*h = s->pageHeight;
+	*w = s->pageSize[page].width;
+	*h = s->pageSize[page].height;
 	*occupancy = 0;
 	*rects = 0;
 	
 	if (!p)
 		p = malloc_safe(*w * *h * sizeof(*p));
 	
-	memset(p, 0, *w * *h * sizeof(*p));
-	
+	/* where each sprite goes */
 	for (r = s->page[page]; r; r = r->nextInPage)
+		++count;
+	span = malloc_safe((count + 1) * sizeof(*span));
+	for (r = s->page[page], i = 0; r; r = r->nextInPage, ++i)
 	{
 		const struct EzSpriteSheetAnimFrame *frame = r->udata;
-		const uint8_t *src8;
-		const uint32_t *src32;
-		int frameWidth;
-		uint32_t *ul = p + r->y * *w + r->x; /* upper left dst image */
+		struct PageSpan *sp = span + i;
+		int x;
 		int y;
+		
+		sp->rect = r;
+		sp->anim = EzSpriteSheetAnimFrame_get_anim(frame);
+		EzSpriteSheetAnimFrame_get_crop(frame, &x, &y, &sp->w, &sp->h);
+		
+		/* reposition to account for padding */
+		sp->x = r->x + pad;
+		sp->y = r->y + pad;
+		
+		/* only the cropped pixels are stored, so untrimmed sprites are
+		 * drawn as their cropping rectangles, and the transparent pixels
+		 * surrounding those are cleared along with the padding
+		 */
+		if (!trim && r->rotated)
+		{
+			sp->x += y;
+			sp->y += EzSpriteSheetAnimFrame_get_width(frame) - x - sp->w;
+		}
+		else if (!trim)
+		{
+			sp->x += x;
+			sp->y += y;
+		}
+		
+		/* swap cropping width/height on rotated rectangles */
+		if (r->rotated)
+		{
+			int tmp = sp->w;
+			sp->w = sp->h;
+			sp->h = tmp;
+		}
+	}
+	
+	/* sprites cover everything else, so only padding and gaps need clearing */
+	PageSpan_clearUncovered(p, *w, *h, span, count);
+	
+	/* copy one animation's sprites after another, so each animation's
+	 * pixels are acquired (and reloaded, if evicted) once per page
+	 */
+	qsort(span, count, sizeof(*span), PageSpan_compareAnim);
+	
+	for (i = 0; i < count; ++i)
+	{
+		struct PageSpan *sp = span + i;
+		const struct EzSpriteSheetAnimFrame *frame = sp->rect->udata;
+		uint32_t *ul = p + sp->y * *w + sp->x; /* upper left dst image */
 		struct
 		{
 			int x;
@@ -513,55 +2634,44 @@ void *EzSpriteSheetRectList_page(struct EzSpriteSheetRectList *s
 		} crop;
 		
 		EzSpriteSheetAnimFrame_get_crop(frame, &crop.x, &crop.y, &crop.w, &crop.h);
-		frameWidth = EzSpriteSheetAnimFrame_get_width(frame);
-		
-		if (!trim)
-		{
-			crop.x = crop.y = 0;
-			crop.w = frameWidth;
-			crop.h = EzSpriteSheetAnimFrame_get_height(frame);
-		}
 		
-		/* select upper left source image with respect to crop rect */
-		src32 = EzSpriteSheetAnimFrame_get_pixels(frame);
-		src32 += crop.y * frameWidth + crop.x;
-		src8 = (void*)src32;
+		if (!i || sp->anim != sp[-1].anim)
+			EzSpriteSheetAnim_acquire(sp->anim);
 		
-		/* reposition to account for padding */
-		ul += pad * *w + pad;
-		
-		/* swap cropping width/height on rotated rectangles */
-		if (r->rotated)
+		/* rotate 90 degrees counter clockwise */
+		if (sp->rect->rotated)
 		{
-			int tmp = crop.w;
-			crop.w = crop.h;
-			crop.h = tmp;
+			if (unrotatedSize < crop.w * crop.h)
+			{
+				unrotatedSize = crop.w * crop.h;
+				unrotated = realloc_safe(unrotated, unrotatedSize * sizeof(*unrotated));
+			}
+			EzSpriteSheetAnimFrame_blit(frame, unrotated, crop.w);
+			rotate_ccw(ul, *w, unrotated, crop.w, crop.w, crop.h);
 		}
+		/* direct copy */
+		else
+			EzSpriteSheetAnimFrame_blit(frame, ul, *w);
 		
-		for (y = 0; y < crop.h; ++y)
-		{
-			uint32_t *d32 = ul + y * *w;
-			uint8_t *d8 = (void*)d32;
-			int x;
-			
-			/* rotate 90 degrees counter clockwise */
-			if (r->rotated)
-				for (x = 0; x < crop.w; ++x, ++d32)
-					*d32 = src32[x * frameWidth + ((crop.h - 1) - y)];
-			/* direct copy */
-			else
-				memcpy(d8, src8 + y * frameWidth * 4, crop.w * 4);
-		}
+		if (i + 1 == count || sp->anim != sp[1].anim)
+			EzSpriteSheetAnim_release(sp->anim);
 		
 		/* report progress */
 		if (progress)
 			progress(((float)(copied++)) / s->count);
 		
 		/* stats */
-		*occupancy += crop.w * crop.h;
+		if (trim)
+			*occupancy += crop.w * crop.h;
+		else
+			*occupancy += EzSpriteSheetAnimFrame_get_width(frame)
+				* EzSpriteSheetAnimFrame_get_height(frame);
 		*rects += 1;
 	}
 	
+	free_safe(&span);
+	free_safe(&unrotated);
+	
 	*occupancy /= *w * *h;
 	
 	return p;
@@ -586,6 +2696,7 @@ void EzSpriteSheetRectList_free(struct EzSpriteSheetRectList **s)
 	}
 	
 	free_safe(&list->page);
+	free_safe(&list->pageSize);
 	
 	free_safe(s);
 }
@@ -597,6 +2708,13 @@ int EzSpriteSheetRectList_getPageCount(const struct EzSpriteSheetRectList *s)
 	return s->pageCount;
 }
 
+void EzSpriteSheetRect_set_key(struct EzSpriteSheetRect *s, uint64_t key)
+{
+	assert(s);
+	
+	s->key = key;
+}
+
 int EzSpriteSheetRect_get_page(const struct EzSpriteSheetRect *s)
 {
 	assert(s);
@@ -625,6 +2743,6 @@ void EzSpriteSheetRect_get_crop(
 	
 	*x = s->x;
 	*y = s->y;
-	*w = s->width;
-	*h = s->height;
+	*w = (s->rotated) ? s->cropHeight : s->cropWidth;
+	*h = (s->rotated) ? s->cropWidth : s->cropHeight;
 }
@@ -0,0 +1,229 @@
+/*
+ * scratch.c <z64.me>
+ * 
+ * EzSpriteSheet's memory-mapped scratch store lives here
+ * 
+ * when a scratch file is open, the cropped pixels of every image
+ * are stored in it instead of on the heap, so it's up to the OS to
+ * page them in and out as sheets are packed and baked; the file is
+ * mapped in segments (at least SCRATCH_SEGMENT bytes apiece) that
+ * never move once mapped, so pointers into it stay valid as it grows
+ * 
+ * space is handed out front to back and is only reclaimed when the
+ * store is closed; the file is deleted as soon as it's created (or
+ * marked for deletion on close, on win32), so it never outlives the
+ * program, even one that dies
+ * 
+ */
+
+#define _FILE_OFFSET_BITS 64 /* for scratch files larger than 2 GiB */
+
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+#endif
+
+#define SCRATCH_SEGMENT (64 << 20) /* bytes mapped at once, at least */
+#define SCRATCH_GRAIN   (64 << 10) /* segment alignment (covers win32) */
+#define SCRATCH_ALIGN   16 /* alignment of each allocation */
+
+struct ScratchSegment
+{
+	void *base;
+	size_t size;
+	size_t used;
+};
+
+static struct
+{
+	char *fn;
+#ifdef _WIN32
+	HANDLE file;
+#else
+	int fd;
+#endif
+	struct ScratchSegment *seg;
+	int count;
+	int64_t end; /* bytes of file spanned by segments */
+	pthread_mutex_t lock;
+} scratch;
+
+/* map a new segment of at least 'bytes' onto the end of the file */
+static struct ScratchSegment *scratch_grow(size_t bytes)
+{
+	struct ScratchSegment *seg;
+	size_t size = SCRATCH_SEGMENT;
+	
+	if (size < bytes)
+		size = (bytes + SCRATCH_GRAIN - 1) & ~(size_t)(SCRATCH_GRAIN - 1);
+	
+	scratch.seg = realloc_safe(scratch.seg, (scratch.count + 1) * sizeof(*scratch.seg));
+	seg = scratch.seg + scratch.count;
+	seg->size = size;
+	seg->used = 0;
+
+#ifdef _WIN32
+	{
+		uint64_t total = scratch.end + size;
+		HANDLE map = CreateFileMapping(scratch.file, 0, PAGE_READWRITE
+			, total >> 32, total & 0xffffffff, 0
+		);
+		
+		seg->base = (map)
+			? MapViewOfFile(map, FILE_MAP_WRITE
+				, (uint64_t)scratch.end >> 32, scratch.end & 0xffffffff
+				, size
+			)
+			: 0;
+		
+		/* the view keeps the mapping alive */
+		if (map)
+			CloseHandle(map);
+	}
+#else
+	if (ftruncate(scratch.fd, scratch.end + size))
+		seg->base = 0;
+	else
+	{
+		seg->base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED
+			, scratch.fd, scratch.end
+		);
+		if (seg->base == MAP_FAILED)
+			seg->base = 0;
+	}
+#endif
+
+	if (!seg->base)
+	{
+		/* the caller holds the lock */
+		pthread_mutex_unlock(&scratch.lock);
+		die("failed to grow scratch file '%s' to %lld bytes"
+			, scratch.fn, (long long)(scratch.end + size)
+		);
+	}
+	
+	scratch.end += size;
+	scratch.count += 1;
+	
+	return seg;
+}
+
+/* store pixels in the given file from now on (any existing file
+ * is overwritten); the store must be closed before it's reopened
+ */
+void scratch_open(const char *fn)
+{
+	assert(fn);
+	assert(!scratch.fn);
+	
+	memset(&scratch, 0, sizeof(scratch));
+
+#if defined(_WIN32) && (defined(_UNICODE) || defined(UNICODE))
+	{
+		WCHAR *wfn = char2wchar(fn);
+		scratch.file = CreateFileW(wfn, GENERIC_READ | GENERIC_WRITE, 0, 0
+			, CREATE_ALWAYS
+			, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE
+			, 0
+		);
+		char2wchar_free(&wfn);
+	}
+	if (scratch.file == INVALID_HANDLE_VALUE)
+#elif defined(_WIN32)
+	scratch.file = CreateFileA(fn, GENERIC_READ | GENERIC_WRITE, 0, 0
+		, CREATE_ALWAYS
+		, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE
+		, 0
+	);
+	if (scratch.file == INVALID_HANDLE_VALUE)
+#else
+	scratch.fd = open(fn, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (scratch.fd < 0)
+#endif
+		die("failed to create scratch file '%s'", fn);
+
+#ifndef _WIN32
+	/* the descriptor and the mappings keep it alive until closed */
+	unlink(fn);
+#endif
+	
+	scratch.fn = strdup_safe(fn);
+	pthread_mutex_init(&scratch.lock, 0);
+}
+
+/* unmap and delete the scratch file; every pointer it handed out
+ * becomes invalid
+ */
+void scratch_close(void)
+{
+	int i;
+	
+	if (!scratch.fn)
+		return;
+	
+	for (i = 0; i < scratch.count; ++i)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(scratch.seg[i].base);
+#else
+		munmap(scratch.seg[i].base, scratch.seg[i].size);
+#endif
+	}
+	
+	/* deleted on close (or already, if not win32) */
+#ifdef _WIN32
+	CloseHandle(scratch.file);
+#else
+	close(scratch.fd);
+#endif
+
+	pthread_mutex_destroy(&scratch.lock);
+	free_safe(&scratch.seg);
+	free_safe(&scratch.fn);
+	memset(&scratch, 0, sizeof(scratch));
+}
+
+/* non-zero while a scratch file is open */
+int scratch_isOpen(void)
+{
+	return scratch.fn != 0;
+}
+
+/* reserve bytes in the scratch file, returning where they're mapped;
+ * safe to call from multiple threads at once
+ */
+void *scratch_alloc(size_t bytes)
+{
+	struct ScratchSegment *seg;
+	void *p;
+	
+	assert(scratch.fn);
+	
+	bytes = (bytes + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+	if (!bytes)
+		bytes = SCRATCH_ALIGN;
+	
+	pthread_mutex_lock(&scratch.lock);
+	
+	/* continue where the last segment left off, if it fits */
+	seg = (scratch.count) ? scratch.seg + scratch.count - 1 : 0;
+	if (!seg || seg->size - seg->used < bytes)
+		seg = scratch_grow(bytes);
+	
+	p = (char*)seg->base + seg->used;
+	seg->used += bytes;
+	
+	pthread_mutex_unlock(&scratch.lock);
+	
+	return p;
+}
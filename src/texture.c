@@ -0,0 +1,549 @@
+/*
+ * texture.c <z64.me>
+ * 
+ * EzSpriteSheet's block-compressed texture writer lives here
+ * 
+ * sheets are encoded as BC1 (DXT1) or BC3 (DXT5) and written to DDS
+ * files, which GPUs can sample without any transcoding at load time;
+ * each 4x4 block is fitted along the principal axis of its colors,
+ * then refined once by least squares, and blocks are encoded across
+ * threads one row of blocks at a time
+ * 
+ * BC1 has 1-bit alpha, so any block with a pixel below half opacity
+ * uses BC1's three-color mode, where the fourth index is transparent;
+ * BC3 pairs a BC1 color block with an interpolated alpha block, and
+ * colors under fully transparent pixels are not fitted at all
+ * 
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define TEXTURE_REFINE 8 /* most least squares passes per color block */
+
+/* the image being encoded */
+struct Texture
+{
+	const uint8_t *rgba;
+	uint8_t *blocks;
+	enum EzSpriteSheetTexture format;
+	int blockBytes;
+	int blocksWide;
+	int w;
+	int h;
+};
+
+static int texture_distance(const int a[3], const int b[3])
+{
+	int r = a[0] - b[0];
+	int g = a[1] - b[1];
+	int b_ = a[2] - b[2];
+	
+	return r * r + g * g + b_ * b_;
+}
+
+static int texture_pack565(const float c[3])
+{
+	int r = c[0] * 31 / 255 + 0.5f;
+	int g = c[1] * 63 / 255 + 0.5f;
+	int b = c[2] * 31 / 255 + 0.5f;
+	
+	r = (r < 0) ? 0 : (r > 31) ? 31 : r;
+	g = (g < 0) ? 0 : (g > 63) ? 63 : g;
+	b = (b < 0) ? 0 : (b > 31) ? 31 : b;
+	
+	return (r << 11) | (g << 5) | b;
+}
+
+static void texture_unpack565(int c, int dst[3])
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	
+	dst[0] = (r << 3) | (r >> 2);
+	dst[1] = (g << 2) | (g >> 4);
+	dst[2] = (b << 3) | (b >> 2);
+}
+
+/* the colors a pair of endpoints decode to (three = three-color mode) */
+static void texture_palette(int c0, int c1, int three, int palette[4][3])
+{
+	int i;
+	
+	texture_unpack565(c0, palette[0]);
+	texture_unpack565(c1, palette[1]);
+	
+	for (i = 0; i < 3; ++i)
+	{
+		if (three)
+		{
+			palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+			palette[3][i] = 0;
+		}
+		else
+		{
+			palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+			palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+		}
+	}
+}
+
+/* pick each used pixel's nearest palette entry; returns total error */
+static int texture_indices(const int px[16][3], const int used[16], int c0, int c1, int three, int index[16])
+{
+	int palette[4][3];
+	int error = 0;
+	int i;
+	
+	texture_palette(c0, c1, three, palette);
+	
+	for (i = 0; i < 16; ++i)
+	{
+		int best = 0;
+		int bestError = texture_distance(px[i], palette[0]);
+		int k;
+		
+		if (!used[i])
+			continue;
+		
+		for (k = 1; k < 4 - three; ++k)
+		{
+			int e = texture_distance(px[i], palette[k]);
+			
+			if (e < bestError)
+			{
+				best = k;
+				bestError = e;
+			}
+		}
+		
+		index[i] = best;
+		error += bestError;
+	}
+	
+	return error;
+}
+
+/* endpoints best fitting the pixels given their indices, by solving
+ * the least squares problem; returns 0 if it's degenerate
+ */
+static int texture_refine(const int px[16][3], const int used[16], const int index[16], int three, float a[3], float b[3])
+{
+	static const float weights[2][4] = {
+		{ 1, 0, 2.0f / 3, 1.0f / 3 }
+		, { 1, 0, 0.5f, 0 }
+	};
+	float aa = 0;
+	float ab = 0;
+	float bb = 0;
+	float ax[3] = {0};
+	float bx[3] = {0};
+	float det;
+	int i;
+	int k;
+	
+	for (i = 0; i < 16; ++i)
+	{
+		float wa;
+		float wb;
+		
+		if (!used[i])
+			continue;
+		
+		wa = weights[three][index[i]];
+		wb = 1 - wa;
+		aa += wa * wa;
+		ab += wa * wb;
+		bb += wb * wb;
+		for (k = 0; k < 3; ++k)
+		{
+			ax[k] += wa * px[i][k];
+			bx[k] += wb * px[i][k];
+		}
+	}
+	
+	det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+		return 0;
+	
+	for (k = 0; k < 3; ++k)
+	{
+		a[k] = (bb * ax[k] - ab * bx[k]) / det;
+		b[k] = (aa * bx[k] - ab * ax[k]) / det;
+	}
+	
+	return 1;
+}
+
+/* encode a color block; pixels whose 'used' is 0 don't matter, and
+ * with 'three', those are written as transparent
+ */
+static void texture_color(uint8_t out[8], const int px[16][3], const int used[16], int three)
+{
+	float mean[3] = {0};
+	float cov[6] = {0};
+	float axis[3];
+	float lo = 1e9f;
+	float hi = -1e9f;
+	float a[3];
+	float b[3];
+	int index[16] = {0};
+	int count = 0;
+	int error;
+	int c0;
+	int c1;
+	int i;
+	int k;
+	
+	for (i = 0; i < 16; ++i)
+	{
+		if (!used[i])
+			continue;
+		for (k = 0; k < 3; ++k)
+			mean[k] += px[i][k];
+		++count;
+	}
+	
+	/* nothing to fit */
+	if (!count)
+	{
+		memset(out, 0, 8);
+		if (three)
+			memset(out + 4, 0xff, 4);
+		return;
+	}
+	
+	for (k = 0; k < 3; ++k)
+		mean[k] /= count;
+	
+	/* principal axis of the colors, by power iteration */
+	for (i = 0; i < 16; ++i)
+	{
+		float r;
+		float g;
+		float b_;
+		
+		if (!used[i])
+			continue;
+		
+		r = px[i][0] - mean[0];
+		g = px[i][1] - mean[1];
+		b_ = px[i][2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b_;
+		cov[3] += g * g;
+		cov[4] += g * b_;
+		cov[5] += b_ * b_;
+	}
+	axis[0] = axis[1] = axis[2] = 1;
+	for (i = 0; i < 8; ++i)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float len = sqrtf(x * x + y * y + z * z);
+		
+		if (len < 1e-6f)
+			break;
+		
+		axis[0] = x / len;
+		axis[1] = y / len;
+		axis[2] = z / len;
+	}
+	
+	/* endpoints at the extremes along that axis */
+	for (i = 0; i < 16; ++i)
+	{
+		float t;
+		
+		if (!used[i])
+			continue;
+		
+		t = (px[i][0] - mean[0]) * axis[0]
+			+ (px[i][1] - mean[1]) * axis[1]
+			+ (px[i][2] - mean[2]) * axis[2]
+		;
+		if (t < lo)
+			lo = t;
+		if (t > hi)
+			hi = t;
+	}
+	for (k = 0; k < 3; ++k)
+	{
+		a[k] = mean[k] + axis[k] * hi;
+		b[k] = mean[k] + axis[k] * lo;
+	}
+	c0 = texture_pack565(a);
+	c1 = texture_pack565(b);
+	error = texture_indices(px, used, c0, c1, three, index);
+	
+	/* refine by least squares for as long as that helps */
+	for (k = 0; k < TEXTURE_REFINE && error; ++k)
+	{
+		int refined[16] = {0};
+		int r0;
+		int r1;
+		int e;
+		
+		if (!texture_refine(px, used, index, three, a, b))
+			break;
+		
+		r0 = texture_pack565(a);
+		r1 = texture_pack565(b);
+		e = texture_indices(px, used, r0, r1, three, refined);
+		if (e >= error)
+			break;
+		
+		c0 = r0;
+		c1 = r1;
+		error = e;
+		memcpy(index, refined, sizeof(index));
+	}
+	
+	/* four colors require c0 > c1, three require c0 <= c1 */
+	if ((three && c0 > c1) || (!three && c0 < c1))
+	{
+		int swap = c0;
+		
+		c0 = c1;
+		c1 = swap;
+		for (i = 0; i < 16; ++i)
+			if (index[i] < 2 || !three)
+				index[i] ^= 1;
+	}
+	
+	out[0] = c0;
+	out[1] = c0 >> 8;
+	out[2] = c1;
+	out[3] = c1 >> 8;
+	for (i = 0; i < 4; ++i)
+	{
+		int row = 0;
+		
+		for (k = 0; k < 4; ++k)
+		{
+			int j = i * 4 + k;
+			int idx = (used[j]) ? index[j] : (three) ? 3 : 0;
+			
+			row |= idx << (k * 2);
+		}
+		out[4 + i] = row;
+	}
+}
+
+/* the alpha a pair of endpoints decode to */
+static void texture_alpha_palette(int a0, int a1, int palette[8])
+{
+	int i;
+	
+	palette[0] = a0;
+	palette[1] = a1;
+	
+	if (a0 > a1)
+	{
+		for (i = 1; i < 7; ++i)
+			palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+	}
+	else
+	{
+		for (i = 1; i < 5; ++i)
+			palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static int texture_alpha_indices(const int alpha[16], int a0, int a1, int index[16])
+{
+	int palette[8];
+	int error = 0;
+	int i;
+	
+	texture_alpha_palette(a0, a1, palette);
+	
+	for (i = 0; i < 16; ++i)
+	{
+		int best = 0;
+		int bestError = 256;
+		int k;
+		
+		for (k = 0; k < 8; ++k)
+		{
+			int e = abs(alpha[i] - palette[k]);
+			
+			if (e < bestError)
+			{
+				best = k;
+				bestError = e;
+			}
+		}
+		
+		index[i] = best;
+		error += bestError * bestError;
+	}
+	
+	return error;
+}
+
+/* encode an alpha block, in whichever of its two modes fits better:
+ * eight values between the extremes, or six between the extremes
+ * other than 0 and 255 plus 0 and 255 themselves
+ */
+static void texture_alpha(uint8_t out[8], const int alpha[16])
+{
+	int index[16];
+	int other[16];
+	int lo = 255;
+	int hi = 0;
+	int lo6 = 255;
+	int hi6 = 0;
+	int a0;
+	int a1;
+	int error;
+	uint64_t bits = 0;
+	int i;
+	
+	for (i = 0; i < 16; ++i)
+	{
+		int a = alpha[i];
+		
+		if (a < lo)
+			lo = a;
+		if (a > hi)
+			hi = a;
+		if (a > 0 && a < 255)
+		{
+			if (a < lo6)
+				lo6 = a;
+			if (a > hi6)
+				hi6 = a;
+		}
+	}
+	if (lo6 > hi6)
+		lo6 = hi6 = 0;
+	
+	a0 = hi;
+	a1 = lo;
+	error = texture_alpha_indices(alpha, a0, a1, index);
+	
+	if (error && texture_alpha_indices(alpha, lo6, hi6, other) < error)
+	{
+		a0 = lo6;
+		a1 = hi6;
+		memcpy(index, other, sizeof(index));
+	}
+	
+	out[0] = a0;
+	out[1] = a1;
+	for (i = 0; i < 16; ++i)
+		bits |= (uint64_t)index[i] << (i * 3);
+	for (i = 0; i < 6; ++i)
+		out[2 + i] = bits >> (i * 8);
+}
+
+/* encode one row of blocks (runs on a worker thread) */
+static void texture_each(void *udata, int index)
+{
+	struct Texture *t = udata;
+	uint8_t *out = t->blocks + (size_t)index * t->blocksWide * t->blockBytes;
+	int bx;
+	
+	for (bx = 0; bx < t->blocksWide; ++bx, out += t->blockBytes)
+	{
+		int px[16][3];
+		int alpha[16];
+		int used[16];
+		int three = 0;
+		int i;
+		
+		/* edge blocks repeat the last row and column of pixels */
+		for (i = 0; i < 16; ++i)
+		{
+			int x = bx * 4 + (i & 3);
+			int y = index * 4 + (i >> 2);
+			const uint8_t *p;
+			
+			if (x >= t->w)
+				x = t->w - 1;
+			if (y >= t->h)
+				y = t->h - 1;
+			
+			p = t->rgba + ((size_t)y * t->w + x) * 4;
+			px[i][0] = p[0];
+			px[i][1] = p[1];
+			px[i][2] = p[2];
+			alpha[i] = p[3];
+			
+			if (t->format == EzSpriteSheetTexture_Bc1)
+			{
+				used[i] = p[3] >= 128;
+				three |= !used[i];
+			}
+			else
+				used[i] = p[3] > 0;
+		}
+		
+		if (t->format == EzSpriteSheetTexture_Bc1)
+			texture_color(out, px, used, three);
+		else
+		{
+			texture_alpha(out, alpha);
+			texture_color(out + 8, px, used, 0);
+		}
+	}
+}
+
+static void texture_put32(uint8_t *dst, uint32_t v)
+{
+	dst[0] = v;
+	dst[1] = v >> 8;
+	dst[2] = v >> 16;
+	dst[3] = v >> 24;
+}
+
+/* encode 8-bit RGBA pixels as a DDS file in the given format, using
+ * 'jobs' threads
+ */
+void texture_write(const char *fn, const void *rgba, int w, int h, enum EzSpriteSheetTexture format, int jobs)
+{
+	struct Texture t = {0};
+	uint8_t header[128] = {0};
+	size_t bytes;
+	int blocksHigh;
+	FILE *fp;
+	
+	t.rgba = rgba;
+	t.format = format;
+	t.w = w;
+	t.h = h;
+	t.blockBytes = (format == EzSpriteSheetTexture_Bc1) ? 8 : 16;
+	t.blocksWide = (w + 3) / 4;
+	blocksHigh = (h + 3) / 4;
+	bytes = (size_t)t.blocksWide * blocksHigh * t.blockBytes;
+	t.blocks = malloc_safe(bytes);
+	
+	worker_run(jobs, blocksHigh, texture_each, &t, 0);
+	
+	memcpy(header, "DDS ", 4);
+	texture_put32(header + 4, 124); /* header size */
+	texture_put32(header + 8, 0x81007); /* caps, size, format, linear size */
+	texture_put32(header + 12, h);
+	texture_put32(header + 16, w);
+	texture_put32(header + 20, bytes);
+	texture_put32(header + 76, 32); /* pixel format size */
+	texture_put32(header + 80, 0x4); /* four character code */
+	memcpy(header + 84, (format == EzSpriteSheetTexture_Bc1) ? "DXT1" : "DXT5", 4);
+	texture_put32(header + 108, 0x1000); /* texture */
+	
+	fp = fopen_safe(fn, "wb");
+	fwrite(header, 1, sizeof(header), fp);
+	fwrite(t.blocks, 1, bytes, fp);
+	fclose_safe(&fp);
+	
+	free_safe(&t.blocks);
+}
@@ -0,0 +1,275 @@
+/*
+ * worker.c <z64.me>
+ * 
+ * EzSpriteSheet's tiny worker pool lives here
+ * 
+ * worker_run() hands out job indices to a handful of threads;
+ * the calling thread does no work itself, it only waits on the
+ * pool and reports progress, so progress callbacks (which may
+ * be drawing GUI widgets) always happen on the calling thread
+ * 
+ * popups (GUI message boxes) raised by workers are handed to the
+ * calling thread too, and shown once every job has completed; if a
+ * worker dies, the calling thread shows them right away and exits
+ * in its place
+ * 
+ */
+
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <unistd.h>
+	#include <time.h>
+#endif
+
+/* a popup raised by a worker thread */
+struct WorkerMessage
+{
+	void (*popup)(const char *msg);
+	char *msg;
+};
+
+struct Worker
+{
+	pthread_mutex_t lock;
+	pthread_cond_t finished;
+	void (*each)(void *udata, int index);
+	void *udata;
+	int count; /* number of jobs */
+	int next; /* next job to be handed out */
+	int done; /* number of jobs completed */
+	struct WorkerMessage *message; /* popups for the calling thread */
+	int messageCount;
+	int fatal; /* a worker thread died */
+};
+
+/* the pool the current thread works for, if any */
+static __thread struct Worker *worker_self = 0;
+
+static void *worker_main(void *arg)
+{
+	struct Worker *w = arg;
+	
+	for (;;)
+	{
+		int index;
+		
+		/* grab next job */
+		pthread_mutex_lock(&w->lock);
+		index = w->next++;
+		pthread_mutex_unlock(&w->lock);
+		
+		if (index >= w->count)
+			break;
+		
+		w->each(w->udata, index);
+		
+		/* let the calling thread know */
+		pthread_mutex_lock(&w->lock);
+		w->done += 1;
+		pthread_cond_signal(&w->finished);
+		pthread_mutex_unlock(&w->lock);
+	}
+	
+	return 0;
+}
+
+static void *worker_thread(void *arg)
+{
+	worker_self = arg;
+	
+	return worker_main(arg);
+}
+
+/* show the popups a pool's workers raised, or pass them on if the
+ * calling thread is itself a worker
+ */
+static void worker_flush(struct Worker *w)
+{
+	int i;
+	
+	for (i = 0; i < w->messageCount; ++i)
+	{
+		struct WorkerMessage *m = w->message + i;
+		
+		if (!worker_defer(m->popup, m->msg))
+			m->popup(m->msg);
+		free_safe(&m->msg);
+	}
+	
+	free_safe(&w->message);
+	w->messageCount = 0;
+}
+
+/* hand a popup to the thread that started the current thread's pool;
+ * returns 0 if the current thread isn't a worker, in which case it's
+ * up to the caller to show it
+ */
+int worker_defer(void popup(const char *msg), const char *msg)
+{
+	struct Worker *w = worker_self;
+	struct WorkerMessage *m;
+	
+	if (!w)
+		return 0;
+	
+	pthread_mutex_lock(&w->lock);
+	w->message = realloc_safe(w->message, (w->messageCount + 1) * sizeof(*w->message));
+	m = w->message + w->messageCount;
+	m->popup = popup;
+	m->msg = strdup_safe(msg);
+	w->messageCount += 1;
+	pthread_mutex_unlock(&w->lock);
+	
+	return 1;
+}
+
+/* used by die() on a worker thread: the thread that started the pool
+ * is woken to show the popups and exit, and this thread waits for it
+ * to do so; returns immediately on any other thread
+ */
+void worker_abandon(void)
+{
+	struct Worker *w = worker_self;
+	pthread_cond_t never;
+	
+	if (!w)
+		return;
+	
+	pthread_cond_init(&never, 0);
+	pthread_mutex_lock(&w->lock);
+	w->fatal = 1;
+	pthread_cond_signal(&w->finished);
+	for (;;)
+		pthread_cond_wait(&never, &w->lock);
+}
+
+/* number of processor cores available */
+int worker_count(void)
+{
+	int n;
+
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	n = info.dwNumberOfProcessors;
+#else
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	if (n < 1)
+		n = 1;
+	
+	return n;
+}
+
+/* milliseconds elapsed on a monotonic clock, for time budgets */
+int64_t worker_clock(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* invoke each(udata, index) for index = 0 ... count - 1 across
+ * 'jobs' threads (jobs <= 0 uses one thread per processor core);
+ * returns once every job has completed
+ */
+void worker_run(int jobs
+	, int count
+	, void each(void *udata, int index)
+	, void *udata
+	, void progress(float unit_interval)
+)
+{
+	struct Worker w = {0};
+	pthread_t *thread;
+	int started;
+	int i;
+	
+	assert(each);
+	
+	if (count <= 0)
+		return;
+	
+	if (jobs <= 0)
+		jobs = worker_count();
+	if (jobs > count)
+		jobs = count;
+	
+	/* no threads necessary */
+	if (jobs == 1)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			each(udata, i);
+			
+			if (progress)
+				progress(((float)(i + 1)) / count);
+		}
+		return;
+	}
+	
+	w.each = each;
+	w.udata = udata;
+	w.count = count;
+	pthread_mutex_init(&w.lock, 0);
+	pthread_cond_init(&w.finished, 0);
+	
+	thread = calloc_safe(jobs, sizeof(*thread));
+	for (started = 0; started < jobs; ++started)
+		if (pthread_create(thread + started, 0, worker_thread, &w))
+			break;
+	
+	/* couldn't start any threads, so do the work here instead */
+	if (!started)
+		worker_main(&w);
+	
+	/* report progress as jobs complete */
+	pthread_mutex_lock(&w.lock);
+	while (w.done < count && !w.fatal)
+	{
+		int done;
+		
+		pthread_cond_wait(&w.finished, &w.lock);
+		done = w.done;
+		
+		if (progress)
+		{
+			pthread_mutex_unlock(&w.lock);
+			progress(((float)done) / count);
+			pthread_mutex_lock(&w.lock);
+		}
+	}
+	
+	/* a worker died, so die in its place (the lock is kept, so
+	 * the workers still running can't raise any more popups)
+	 */
+	if (w.fatal)
+	{
+		worker_flush(&w);
+		die(0);
+	}
+	pthread_mutex_unlock(&w.lock);
+	
+	for (i = 0; i < started; ++i)
+		pthread_join(thread[i], 0);
+	
+	worker_flush(&w);
+	free_safe(&thread);
+	pthread_cond_destroy(&w.finished);
+	pthread_mutex_destroy(&w.lock);
+}